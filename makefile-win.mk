@@ -14,6 +14,11 @@ src/compressor.h \
 src/enums.h \
 src/schema.h \
 src/gecko-legacy.h \
+src/lz.h \
+src/dict.h \
+src/sink.h \
+src/columnar.h \
+src/manifest.h \
 src/util.h
 
 OBJS += \
@@ -22,6 +27,8 @@ build-win/replay.o \
 build-win/analyzer.o \
 build-win/analysis.o \
 build-win/compressor.o \
+build-win/columnar.o \
+build-win/manifest.o \
 build-win/main.o
 
 CPP_DEPS += \
@@ -30,6 +37,8 @@ build-win/replay.d \
 build-win/analyzer.d \
 build-win/analysis.d \
 build-win/compressor.d \
+build-win/columnar.d \
+build-win/manifest.d \
 build-win/main.d
 
 DEFINES += \
@@ -61,7 +70,7 @@ targets: directories slippc
 slippc: $(OBJS)
 	@echo 'Building target: $@'
 	@echo 'Invoking: GCC C++ Linker'
-	x86_64-w64-mingw32-g++ -static -static-libgcc -static-libstdc++ -L/usr/x86_64-w64-mingw32/lib/ -std=c++17 -o "./slippc.exe" $(OBJS) $(LIBS)
+	x86_64-w64-mingw32-g++ -static -static-libgcc -static-libstdc++ -L/usr/x86_64-w64-mingw32/lib/ -std=c++17 -o "./slippc.exe" $(OBJS) $(LIBS) -pthread
 	@echo 'Finished building target: $@'
 	@echo ' '
 
@@ -69,7 +78,7 @@ build-win/%.o: ./src/%.cpp $(HEADERS)
 	@echo 'Building file: $<'
 	@echo 'Invoking: GCC C++ Compiler'
 	$(LINK.c) $< -c -o $@
-	x86_64-w64-mingw32-g++ $(DEFINES) $(GUI) $(INCLUDES) -static -static-libgcc -static-libstdc++ $(INCLUDES) $(OLEVEL) -g3 -Wall -c -fmessage-length=0 -std=c++17 $(UNUSED) -o "$@" "$<"
+	x86_64-w64-mingw32-g++ $(DEFINES) $(GUI) $(INCLUDES) -static -static-libgcc -static-libstdc++ $(INCLUDES) $(OLEVEL) -g3 -Wall -pthread -c -fmessage-length=0 -std=c++17 $(UNUSED) -o "$@" "$<"
 	@echo 'Finished building: $<'
 	@echo ' '
 
@@ -1,25 +1,32 @@
 #include "analysis.h"
 
 // JSON Output shortcuts
-#define JFLT(i, k, n) SPACE[ILEV * (i)] << "\"" << (k) << "\" : " << float(n)
-#define JINT(i, k, n) SPACE[ILEV * (i)] << "\"" << (k) << "\" : " << int32_t(n)
-#define JUIN(i, k, n) SPACE[ILEV * (i)] << "\"" << (k) << "\" : " << uint32_t(n)
-#define JSTR(i, k, s)                                                          \
-  SPACE[ILEV * (i)] << "\"" << (k) << "\" : \"" << (s) << "\""
+#define JFLT(i, k, n) JsonKey(ILEV * (i), k) << float(n)
+#define JINT(i, k, n) JsonKey(ILEV * (i), k) << int32_t(n)
+#define JUIN(i, k, n) JsonKey(ILEV * (i), k) << uint32_t(n)
+#define JSTR(i, k, s) JsonKey(ILEV * (i), k) << "\"" << (s) << "\""
 #define JEND(a) ((a++ == 0) ? "\n" : ",\n")
 
 namespace slip {
 
 std::string Analysis::asJson() {
-  std::stringstream ss;
-  ss << "{" << std::endl;
+  std::string json;
+  OutputSink out(
+      [&json](const char *data, size_t len) { json.append(data, len); });
+  writeJson(out);
+  out.close();
+  return json;
+}
+
+void Analysis::writeJson(OutputSink &ss) {
+  ss << "{\n";
 
   ss << JSTR(0, "original_file", escape_json(original_file)) << ",\n";
   ss << JSTR(0, "slippi_version", slippi_version) << ",\n";
   ss << JSTR(0, "parser_version", parser_version) << ",\n";
   ss << JSTR(0, "analyzer_version", analyzer_version) << ",\n";
   ss << JUIN(0, "parse_errors", parse_errors) << ",\n";
-  ss << JSTR(0, "game_time", game_time) << ",\n";
+  ss << JSTR(0, "game_time", escape_json(game_time)) << ",\n";
   ss << JUIN(0, "stage_id", stage_id) << ",\n";
   ss << JSTR(0, "stage_name", stage_name) << ",\n";
   ss << JUIN(0, "game_length", game_length) << ",\n";
@@ -152,7 +159,7 @@ std::string Analysis::asJson() {
 
     ss << SPACE[ILEV] << "\"attacks\" : [\n";
     for (unsigned i = 0; ap[p].attacks[i].frame > 0; ++i) {
-      ss << SPACE[2 * ILEV] << "{" << std::endl;
+      ss << SPACE[2 * ILEV] << "{\n";
       ss << JUIN(2, "move_id", ap[p].attacks[i].move_id) << ",\n";
       ss << JSTR(2, "move_name", Move::shortname[ap[p].attacks[i].move_id])
          << ",\n";
@@ -175,7 +182,7 @@ std::string Analysis::asJson() {
 
     ss << SPACE[ILEV] << "\"punishes\" : [\n";
     for (unsigned i = 0; ap[p].punishes[i].num_moves > 0; ++i) {
-      ss << SPACE[2 * ILEV] << "{" << std::endl;
+      ss << SPACE[2 * ILEV] << "{\n";
       ss << JUIN(2, "start_frame", ap[p].punishes[i].start_frame) << ",\n";
       ss << JUIN(2, "end_frame", ap[p].punishes[i].end_frame) << ",\n";
       ss << JFLT(2, "start_pct", ap[p].punishes[i].start_pct) << ",\n";
@@ -197,15 +204,13 @@ std::string Analysis::asJson() {
   }
   ss << "]\n";
   ss << "}\n";
-  return ss.str();
 }
 
-void Analysis::save(const char *outfilename) {
-  std::ofstream fout;
-  fout.open(outfilename);
-  std::string j = asJson();
-  fout << j << std::endl;
-  fout.close();
+bool Analysis::save(const char *outfilename) {
+  OutputSink out(outfilename);
+  writeJson(out);
+  out << "\n";
+  return out.close();
 }
 
 } // namespace slip
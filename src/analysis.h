@@ -10,6 +10,7 @@
 
 #include "enums.h"
 #include "util.h"
+#include "sink.h"
 
 const unsigned MAX_ATTACKS = 65535;  // Maximum number of attacks per player per
                                      // game (increase later if needed)
@@ -220,7 +221,8 @@ struct Analysis {
   }
 
   std::string asJson(); // Convert the analysis structure to a JSON
-  void save(const char *outfilename); // Write the analysis out to a JSON file
+  void writeJson(OutputSink &out); // Stream the analysis structure as a JSON
+  bool save(const char *outfilename); // Write the analysis out to a JSON file
 };
 
 } // namespace slip
@@ -28,10 +28,16 @@ bool Analyzer::get1v1Ports(const SlippiReplay &s, Analysis *a) const {
 
 void Analyzer::computeAirtime(const SlippiReplay &s, Analysis *a) const {
   for (unsigned pi = 0; pi < 2; ++pi) {
-    SlippiPlayer p = s.player[a->ap[pi].port];
+    const SlippiPlayer &p = s.player[a->ap[pi].port];
     unsigned airframes = 0;
-    for (unsigned f = (-LOAD_FRAME); f < s.frame_count; ++f) {
-      airframes += p.frame[f].airborne;
+    if (p.cols.built()) {
+      for (unsigned f = (-LOAD_FRAME); f < s.frame_count; ++f) {
+        airframes += p.cols.airborne[f];
+      }
+    } else {
+      for (unsigned f = (-LOAD_FRAME); f < s.frame_count; ++f) {
+        airframes += p.frame[f].airborne;
+      }
     }
 
     a->ap[pi].air_frames = airframes;
@@ -115,19 +121,20 @@ void Analyzer::summarizeInteractions(const SlippiReplay &s, Analysis *a) const {
 
 void Analyzer::countLCancels(const SlippiReplay &s, Analysis *a) const {
   for (unsigned pi = 0; pi < 2; ++pi) {
-    SlippiPlayer p = s.player[a->ap[pi].port];
+    const SlippiPlayer &p = s.player[a->ap[pi].port];
     unsigned cancels_hit = 0;
     unsigned cancels_miss = 0;
     unsigned last_state = 0;
     for (unsigned f = (-LOAD_FRAME); f < s.frame_count; ++f) {
+      unsigned state = p.cols.built() ? p.cols.l_cancel[f] : p.frame[f].l_cancel;
       if (last_state == 0) {
-        if (p.frame[f].l_cancel == 1) {
+        if (state == 1) {
           cancels_hit += 1;
-        } else if (p.frame[f].l_cancel == 2) {
+        } else if (state == 2) {
           cancels_miss += 1;
         }
       }
-      last_state = p.frame[f].l_cancel;
+      last_state = state;
     }
 
     a->ap[pi].l_cancels_hit = cancels_hit;
@@ -141,7 +148,7 @@ void Analyzer::countLCancels(const SlippiReplay &s, Analysis *a) const {
 
 void Analyzer::countButtons(const SlippiReplay &s, Analysis *a) const {
   for (unsigned pi = 0; pi < 2; ++pi) {
-    SlippiPlayer p = s.player[a->ap[pi].port];
+    const SlippiPlayer &p = s.player[a->ap[pi].port];
     uint16_t last_buttons = 0;
     float last_ax = 0;
     float last_ay = 0;
@@ -176,7 +183,7 @@ void Analyzer::countButtons(const SlippiReplay &s, Analysis *a) const {
 
 void Analyzer::countTechs(const SlippiReplay &s, Analysis *a) const {
   for (unsigned pi = 0; pi < 2; ++pi) {
-    SlippiPlayer p = s.player[a->ap[pi].port];
+    const SlippiPlayer &p = s.player[a->ap[pi].port];
     unsigned techs_hit = 0;
     unsigned walltechs_hit = 0; // And ceiling techs
     unsigned walljumps_hit = 0;
@@ -224,7 +231,7 @@ void Analyzer::countTechs(const SlippiReplay &s, Analysis *a) const {
 
 void Analyzer::countDashdances(const SlippiReplay &s, Analysis *a) const {
   for (unsigned pi = 0; pi < 2; ++pi) {
-    SlippiPlayer p = s.player[a->ap[pi].port];
+    const SlippiPlayer &p = s.player[a->ap[pi].port];
     unsigned dashdances = 0;
     for (unsigned f = (-LOAD_FRAME); f < s.frame_count; ++f) {
       if (isDashdancing(p, f)) {
@@ -241,7 +248,7 @@ void Analyzer::countDashdances(const SlippiReplay &s, Analysis *a) const {
 void Analyzer::countAirdodgesAndWavelands(const SlippiReplay &s,
                                           Analysis *a) const {
   for (unsigned pi = 0; pi < 2; ++pi) {
-    SlippiPlayer p = s.player[a->ap[pi].port];
+    const SlippiPlayer &p = s.player[a->ap[pi].port];
     int airdodges = 0;
     unsigned wavelands = 0;
     unsigned wavedashes = 0;
@@ -321,7 +328,7 @@ void Analyzer::analyzeInteractions(const SlippiReplay &s, Analysis *a) const {
     SlippiFrame pf = p->frame[f];
     oHitLastFrame = oHitThisFrame;
     oHitThisFrame = false;
-    bool oInHitstun = isInHitstun(of);
+    bool oInHitstun = isInHitstun(o->frame, f);
     if (oInHitstun) {
       oLastInHitsun = f;
       if (of.percent_post > o->frame[f - 1].percent_post) {
@@ -331,7 +338,7 @@ void Analyzer::analyzeInteractions(const SlippiReplay &s, Analysis *a) const {
     }
     pHitLastFrame = pHitThisFrame;
     pHitThisFrame = false;
-    bool pInHitstun = isInHitstun(pf);
+    bool pInHitstun = isInHitstun(p->frame, f);
     if (pInHitstun) {
       pLastInHitsun = f;
       if (pf.percent_post > p->frame[f - 1].percent_post) {
@@ -349,12 +356,12 @@ void Analyzer::analyzeInteractions(const SlippiReplay &s, Analysis *a) const {
     }
     bool oIsGrabbed = isGrabbed(of);
     bool pIsGrabbed = isGrabbed(pf);
-    bool oOnLedge = isOnLedge(of);
-    bool pOnLedge = isOnLedge(pf);
+    bool oOnLedge = isOnLedge(o->frame, f);
+    bool pOnLedge = isOnLedge(p->frame, f);
     bool oShielding = isShielding(of);
     bool pShielding = isShielding(pf);
-    bool oInShieldstun = isInShieldstun(of);
-    bool pInShieldstun = isInShieldstun(pf);
+    bool oInShieldstun = isInShieldstun(o->frame, f);
+    bool pInShieldstun = isInShieldstun(p->frame, f);
     bool oTeching = inFloorTechState(of);
     bool pTeching = inFloorTechState(pf);
     bool oThrown = isThrown(of);
@@ -596,6 +603,9 @@ void Analyzer::analyzeInteractions(const SlippiReplay &s, Analysis *a) const {
 }
 
 void Analyzer::analyzePunishes(const SlippiReplay &s, Analysis *a) const {
+  if (s.frame_count <= FIRST_FRAME) {
+    return; // Game ended before any playable frames; nothing to punish
+  }
   const SlippiPlayer *p = &(s.player[a->ap[0].port]);
   const SlippiPlayer *o = &(s.player[a->ap[1].port]);
   unsigned pa = 0; // Running tally of player attacks
@@ -616,8 +626,8 @@ void Analyzer::analyzePunishes(const SlippiReplay &s, Analysis *a) const {
     SlippiFrame of = o->frame[f];
     cur_dyn = a->dynamics[f];
 
-    oLastInHitsun = isInHitstun(o->frame[f]) ? f : oLastInHitsun;
-    pLastInHitsun = isInHitstun(p->frame[f]) ? f : pLastInHitsun;
+    oLastInHitsun = isInHitstun(o->frame, f) ? f : oLastInHitsun;
+    pLastInHitsun = isInHitstun(p->frame, f) ? f : pLastInHitsun;
     bool oPoked = ((f - oLastInHitsun) <
                    POKE_THRES); // Check if opponent has been poked recently
     bool pPoked = ((f - pLastInHitsun) <
@@ -836,12 +846,12 @@ void Analyzer::analyzeCancels(const SlippiReplay &s, Analysis *a) const {
         }
         for (unsigned f = attacks[i].frame; f < last_frame; ++f) {
           // Check if we had the opportunity to edge cancel
-          if (didEdgeCancelAerial(p->frame[f])) {
+          if (didEdgeCancelAerial(p->frame, f)) {
             attacks[i].cancel_type = Cancel::EDGE;
             break;
           }
           // Check if we had the opportunity to teeter cancel
-          if (didTeeterCancelAerial(p->frame[f])) {
+          if (didTeeterCancelAerial(p->frame, f)) {
             attacks[i].cancel_type = Cancel::TEETER;
             break;
           }
@@ -879,76 +889,77 @@ void Analyzer::analyzeShield(const SlippiReplay &s, Analysis *a) const {
   }
 }
 
-unsigned Analyzer::countTransitions(const SlippiReplay &s, Analysis *a,
-                                    unsigned pnum,
-                                    bool (*cb)(const SlippiFrame &)) const {
-  SlippiPlayer p = s.player[a->ap[pnum].port];
-  unsigned counter = 0;
-  bool active = false;
-  for (unsigned f = (-LOAD_FRAME); f < s.frame_count; ++f) {
-    if (cb(p.frame[f])) {
-      if (not active) {
-        ++counter;
-        active = true;
-      }
-    } else {
-      active = false;
-    }
+template <typename Frames>
+void Analyzer::sweepBasicAnimations(const Frames &p, unsigned frame_count,
+                                    AnalysisPlayer &ap,
+                                    AnalysisPlayer &op) const {
+  TransitionCounter state_changes, ledge_grabs, rolls, spotdodges,
+      powershields, grabs, taunts, meteor_cancels, hits_blocked,
+      edge_cancel_aerials, edge_cancel_specials, teeter_cancel_aerials,
+      teeter_cancel_specials, no_impact_lands, shield_drops, pivots,
+      short_hops, hops, shield_breaks, grab_escapes, shield_stabs,
+      stage_spikes;
+  for (unsigned f = (-LOAD_FRAME); f < frame_count; ++f) {
+    state_changes.update(didActionStateChange(p, f));
+    ledge_grabs.update(isOnLedge(p, f));
+    rolls.update(isRolling(p, f));
+    spotdodges.update(isSpotdodging(p, f));
+    powershields.update(didPowerShield(p, f));
+    grabs.update(isGrabbing(p, f));
+    taunts.update(isTaunting(p, f));
+    meteor_cancels.update(didMeteorCancel(p, f));
+    hits_blocked.update(isInShieldstun(p, f));
+    edge_cancel_aerials.update(didEdgeCancelAerial(p, f));
+    edge_cancel_specials.update(didEdgeCancelSpecial(p, f));
+    teeter_cancel_aerials.update(didTeeterCancelAerial(p, f));
+    teeter_cancel_specials.update(didTeeterCancelSpecial(p, f));
+    no_impact_lands.update(didNoImpactLand(p, f));
+    shield_drops.update(didShieldDrop(p, f));
+    pivots.update(didPivot(p, f));
+    short_hops.update(didShortHop(p, f));
+    hops.update(didHop(p, f));
+    shield_breaks.update(isShieldBroken(p, f));
+    grab_escapes.update(isReleasing(p, f));
+    shield_stabs.update(wasShieldStabbed(p, f));
+    stage_spikes.update(wasStageSpiked(p, f));
   }
-  return counter;
-}
 
-unsigned Analyzer::countTransitions(const SlippiReplay &s, Analysis *a,
-                                    unsigned pnum,
-                                    bool (*cb)(const SlippiPlayer &,
-                                               const unsigned)) const {
-  SlippiPlayer p = s.player[a->ap[pnum].port];
-  unsigned counter = 0;
-  bool active = false;
-  for (unsigned f = (-LOAD_FRAME); f < s.frame_count; ++f) {
-    if (cb(p, f)) {
-      if (not active) {
-        ++counter;
-        active = true;
-      }
-    } else {
-      active = false;
-    }
-  }
-  return counter;
+  ap.state_changes = state_changes.count;
+  ap.ledge_grabs = ledge_grabs.count;
+  ap.rolls = rolls.count;
+  ap.spotdodges = spotdodges.count;
+  ap.powershields = powershields.count;
+  ap.grabs = grabs.count;
+  ap.taunts = taunts.count;
+  ap.meteor_cancels = meteor_cancels.count;
+  ap.hits_blocked = hits_blocked.count;
+  ap.edge_cancel_aerials = edge_cancel_aerials.count;
+  ap.edge_cancel_specials = edge_cancel_specials.count;
+  ap.teeter_cancel_aerials = teeter_cancel_aerials.count;
+  ap.teeter_cancel_specials = teeter_cancel_specials.count;
+  ap.no_impact_lands = no_impact_lands.count;
+  ap.shield_drops = shield_drops.count;
+  ap.pivots = pivots.count;
+  ap.short_hops = short_hops.count;
+  ap.full_hops = hops.count - short_hops.count;
+
+  // these are things that happen to this player, so they count for the opponent
+  op.shield_breaks = shield_breaks.count;
+  op.grab_escapes = grab_escapes.count;
+  op.shield_stabs = shield_stabs.count;
+  op.stage_spikes = stage_spikes.count;
 }
 
 void Analyzer::countBasicAnimations(const SlippiReplay &s, Analysis *a) const {
+  // one sweep over each player's frames, reading from the columnar frame
+  //   store if the replay has one
   for (unsigned pi = 0; pi < 2; ++pi) {
-    a->ap[pi].state_changes = countTransitions(s, a, pi, didActionStateChange);
-
-    a->ap[pi].ledge_grabs = countTransitions(s, a, pi, isOnLedge);
-    a->ap[pi].rolls = countTransitions(s, a, pi, isRolling);
-    a->ap[pi].spotdodges = countTransitions(s, a, pi, isSpotdodging);
-    a->ap[pi].powershields = countTransitions(s, a, pi, didPowerShield);
-    a->ap[pi].grabs = countTransitions(s, a, pi, isGrabbing);
-    a->ap[pi].taunts = countTransitions(s, a, pi, isTaunting);
-    a->ap[pi].meteor_cancels = countTransitions(s, a, pi, didMeteorCancel);
-    a->ap[pi].hits_blocked = countTransitions(s, a, pi, isInShieldstun);
-    a->ap[pi].edge_cancel_aerials =
-        countTransitions(s, a, pi, didEdgeCancelAerial);
-    a->ap[pi].edge_cancel_specials =
-        countTransitions(s, a, pi, didEdgeCancelSpecial);
-    a->ap[pi].teeter_cancel_aerials =
-        countTransitions(s, a, pi, didTeeterCancelAerial);
-    a->ap[pi].teeter_cancel_specials =
-        countTransitions(s, a, pi, didTeeterCancelSpecial);
-    a->ap[pi].no_impact_lands = countTransitions(s, a, pi, didNoImpactLand);
-    a->ap[pi].shield_drops = countTransitions(s, a, pi, didShieldDrop);
-    a->ap[pi].pivots = countTransitions(s, a, pi, didPivot);
-    a->ap[pi].short_hops = countTransitions(s, a, pi, didShortHop);
-    a->ap[pi].full_hops =
-        countTransitions(s, a, pi, didHop) - a->ap[pi].short_hops;
-
-    a->ap[pi].shield_breaks = countTransitions(s, a, 1 - pi, isShieldBroken);
-    a->ap[pi].grab_escapes = countTransitions(s, a, 1 - pi, isReleasing);
-    a->ap[pi].shield_stabs = countTransitions(s, a, 1 - pi, wasShieldStabbed);
-    a->ap[pi].stage_spikes = countTransitions(s, a, 1 - pi, wasStageSpiked);
+    const SlippiPlayer &p = s.player[a->ap[pi].port];
+    if (p.cols.built()) {
+      sweepBasicAnimations(p.cols, s.frame_count, a->ap[pi], a->ap[1 - pi]);
+    } else {
+      sweepBasicAnimations(p.frame, s.frame_count, a->ap[pi], a->ap[1 - pi]);
+    }
   }
 }
 
@@ -997,8 +1008,8 @@ void Analyzer::countLedgedashes(const SlippiReplay &s, Analysis *a) const {
         SlippiFrame pf = p->frame[f];
         bool landed = isLanding(p->frame[f - 1]) && (not isLanding(pf)) &&
                       (not isAirborne(pf));
-        if ((didNoImpactLand(pf) || landed) && (not isInHitlag(pf)) &&
-            (not isInHitstun(pf))) {
+        if ((didNoImpactLand(p->frame, f) || landed) && (not isInHitlag(pf)) &&
+            (not isInHitstun(p->frame, f))) {
           if (a->ap[pi].max_galint < galint) {
             a->ap[pi].max_galint = galint;
           }
@@ -1114,7 +1125,7 @@ void Analyzer::countActionability(const SlippiReplay &s, Analysis *a) const {
       SlippiFrame pf = p->frame[f];
 
       // Count the number of frames we take to act out of hitstun
-      if (isInHitstun(pf)) {
+      if (isInHitstun(p->frame, f)) {
         if (!was_in_hitstun) {
           was_in_hitstun = true;
           ++hitstun_times;
@@ -1125,7 +1136,7 @@ void Analyzer::countActionability(const SlippiReplay &s, Analysis *a) const {
           ++hitstun_act_cur;
           ++hitstun_act;
         } else {
-          if ((MAX_WAIT < hitstun_act_cur) || wasStageSpiked(pf) ||
+          if ((MAX_WAIT < hitstun_act_cur) || wasStageSpiked(p->frame, f) ||
               inMissedTechState(pf)) {
             --hitstun_times; // We're not trying to act out of stun
           } else {
@@ -1138,7 +1149,7 @@ void Analyzer::countActionability(const SlippiReplay &s, Analysis *a) const {
 
       // Count the number of frames we take to act out of shieldstun
       unsigned max_shield_wait = MAX_WAIT;
-      if (isInShieldstun(pf)) {
+      if (isInShieldstun(p->frame, f)) {
         if (!was_in_shieldstun) {
           was_in_shieldstun = true;
           ++shieldstun_times;
@@ -11,7 +11,7 @@
 #include "analysis.h"
 
 //Version number for the analyzer
-const std::string ANALYZER_VERSION = "0.8.0";
+const std::string ANALYZER_VERSION = "0.8.1";
 
 const unsigned TIMER_MINS    = 8;     //Assuming a fixed 8 minute time for now (TODO: might need to change later)
 const unsigned SHARK_THRES   = 15;    //Minimum frames to be out of hitstun before comboing becomes sharking
@@ -45,12 +45,35 @@ private:
   void     countMoves                 (const SlippiReplay &s, Analysis *a) const;
   void     showActionStates           (const SlippiReplay &s, Analysis *a) const;
   void     computeTrivialInfo         (const SlippiReplay &s, Analysis *a) const;
-  unsigned countTransitions           (const SlippiReplay &s, Analysis *a, unsigned pnum, bool (*cb)(const SlippiFrame&)) const;
-  unsigned countTransitions           (const SlippiReplay &s, Analysis *a, unsigned pnum, bool (*cb)(const SlippiPlayer &, const unsigned)) const;
+  template <typename Frames>
+  void     sweepBasicAnimations       (const Frames &p, unsigned frame_count, AnalysisPlayer &ap, AnalysisPlayer &op) const;
+
+  //Tracks how many times a check becomes true over consecutive frames
+  struct TransitionCounter {
+    unsigned count  = 0;
+    bool     active = false;
+    inline void update(bool now) {
+      count += (now && (not active));
+      active = now;
+    }
+  };
+
+  //Per-field reads from either frame store (a player's SlippiFrame array or
+  //  its SlippiFrameColumns), so the checks templated on Frames below have a
+  //  single definition for both
+  static inline uint16_t getActionPre(const SlippiFrame* p, const unsigned f)          { return p[f].action_pre; }
+  static inline uint16_t getActionPre(const SlippiFrameColumns &c, const unsigned f)   { return c.action_pre[f]; }
+  static inline uint16_t getActionPost(const SlippiFrame* p, const unsigned f)         { return p[f].action_post; }
+  static inline uint16_t getActionPost(const SlippiFrameColumns &c, const unsigned f)  { return c.action_post[f]; }
+  static inline uint16_t getButtons(const SlippiFrame* p, const unsigned f)            { return p[f].buttons; }
+  static inline uint16_t getButtons(const SlippiFrameColumns &c, const unsigned f)     { return c.buttons[f]; }
+  static inline uint8_t  getFlags4(const SlippiFrame* p, const unsigned f)             { return p[f].flags_4; }
+  static inline uint8_t  getFlags4(const SlippiFrameColumns &c, const unsigned f)      { return c.flags_4[f]; }
+  static inline float    getHitStun(const SlippiFrame* p, const unsigned f)            { return p[f].hitstun; }
+  static inline float    getHitStun(const SlippiFrameColumns &c, const unsigned f)     { return c.hitstun[f]; }
+  static inline float    getPercentPost(const SlippiFrame* p, const unsigned f)        { return p[f].percent_post; }
+  static inline float    getPercentPost(const SlippiFrameColumns &c, const unsigned f) { return c.percent_post[f]; }
 
-  static inline float getHitStun(const SlippiFrame &f) {
-    return f.hitstun;
-  }
   static inline float playerDistance(const SlippiFrame &pf, const SlippiFrame &of) {
     float xd = pf.pos_x_pre - of.pos_x_pre;
     float yd = pf.pos_y_pre - of.pos_y_pre;
@@ -71,84 +94,98 @@ private:
       //Defender's damage increased since last frame
     return isInHitlag(p.frame[f-2]) &&
       (not isInHitlag(o.frame[f-2])) &&
-      (not isInHitstun(p.frame[f])) &&
+      (not isInHitstun(p.frame,f)) &&
       (not isThrowing(o.frame[f])) &&
       p.frame[f-1].percent_pre < p.frame[f].percent_post
       ;
   }
-  static inline bool wasShieldStabbed(const SlippiPlayer &p, const unsigned f) {
-    return p.frame[f-1].action_post >= Action::GuardOn
-      && p.frame[f-1].action_post <= Action::GuardReflect
-      && p.frame[f].percent_post > p.frame[f-1].percent_post;
-  }
-  static inline bool wasStageSpiked(const SlippiFrame &f) {
-    return (f.action_pre == Action::FlyReflectWall || f.action_pre == Action::FlyReflectCeil)
-      && f.action_post <= Action::DeadUpFallHitCameraIce;
-  }
-  static inline bool didEdgeCancelAerial(const SlippiFrame &f) {
-    return f.action_post >= Action::Fall
-      && f.action_post <= Action::FallB
-      && f.action_pre >= Action::LandingAirN
-      && f.action_pre <= Action::LandingAirLw;
-  }
-  static inline bool didTeeterCancelAerial(const SlippiFrame &f) {
-    return f.action_post >= Action::Ottotto
-      && f.action_post <= Action::OttottoWait
-      && f.action_pre >= Action::LandingAirN
-      && f.action_pre <= Action::LandingAirLw;
+  template <typename Frames>
+  static inline bool wasShieldStabbed(const Frames &p, const unsigned f) {
+    return getActionPost(p,f-1) >= Action::GuardOn
+      && getActionPost(p,f-1) <= Action::GuardReflect
+      && getPercentPost(p,f) > getPercentPost(p,f-1);
+  }
+  template <typename Frames>
+  static inline bool wasStageSpiked(const Frames &p, const unsigned f) {
+    return (getActionPre(p,f) == Action::FlyReflectWall || getActionPre(p,f) == Action::FlyReflectCeil)
+      && getActionPost(p,f) <= Action::DeadUpFallHitCameraIce;
+  }
+  template <typename Frames>
+  static inline bool didEdgeCancelAerial(const Frames &p, const unsigned f) {
+    return getActionPost(p,f) >= Action::Fall
+      && getActionPost(p,f) <= Action::FallB
+      && getActionPre(p,f) >= Action::LandingAirN
+      && getActionPre(p,f) <= Action::LandingAirLw;
+  }
+  template <typename Frames>
+  static inline bool didTeeterCancelAerial(const Frames &p, const unsigned f) {
+    return getActionPost(p,f) >= Action::Ottotto
+      && getActionPost(p,f) <= Action::OttottoWait
+      && getActionPre(p,f) >= Action::LandingAirN
+      && getActionPre(p,f) <= Action::LandingAirLw;
   }
   static inline bool didAutoCancelAerial(const SlippiFrame &f) {
     return f.action_post == Action::Landing
       && f.action_pre >= Action::AttackAirN
       && f.action_pre <= Action::AttackAirLw;
   }
-  static inline bool didNoImpactLand(const SlippiFrame &f) {
-    return f.action_pre >= Action::JumpF
-      && f.action_pre <= Action::JumpAerialB
-      && f.action_post == Action::Wait;
-  }
-  static inline bool didShieldDrop(const SlippiFrame &f) {
-    return f.action_pre >= Action::GuardOn
-      && f.action_pre <= Action::GuardOff
-      && f.action_post == Action::Pass;
-  }
-  static inline bool didEdgeCancelSpecial(const SlippiFrame &f) {
-    return f.action_post >= Action::Fall
-      && f.action_post <= Action::FallB
-      && f.action_pre == Action::LandingFallSpecial;
-  }
-  static inline bool didTeeterCancelSpecial(const SlippiFrame &f) {
-    return f.action_post >= Action::Ottotto
-      && f.action_post <= Action::OttottoWait
-      && f.action_pre == Action::LandingFallSpecial;
-  }
-  static inline bool didPivot(const SlippiPlayer &p, const unsigned f) {
-    return p.frame[f].action_pre == Action::Turn
-      && p.frame[f-1].action_pre == Action::Dash
-      && p.frame[f].action_post != Action::Dash
-      && (not isInHitstun(p.frame[f]))
+  template <typename Frames>
+  static inline bool didNoImpactLand(const Frames &p, const unsigned f) {
+    return getActionPre(p,f) >= Action::JumpF
+      && getActionPre(p,f) <= Action::JumpAerialB
+      && getActionPost(p,f) == Action::Wait;
+  }
+  template <typename Frames>
+  static inline bool didShieldDrop(const Frames &p, const unsigned f) {
+    return getActionPre(p,f) >= Action::GuardOn
+      && getActionPre(p,f) <= Action::GuardOff
+      && getActionPost(p,f) == Action::Pass;
+  }
+  template <typename Frames>
+  static inline bool didEdgeCancelSpecial(const Frames &p, const unsigned f) {
+    return getActionPost(p,f) >= Action::Fall
+      && getActionPost(p,f) <= Action::FallB
+      && getActionPre(p,f) == Action::LandingFallSpecial;
+  }
+  template <typename Frames>
+  static inline bool didTeeterCancelSpecial(const Frames &p, const unsigned f) {
+    return getActionPost(p,f) >= Action::Ottotto
+      && getActionPost(p,f) <= Action::OttottoWait
+      && getActionPre(p,f) == Action::LandingFallSpecial;
+  }
+  template <typename Frames>
+  static inline bool didPivot(const Frames &p, const unsigned f) {
+    return getActionPre(p,f) == Action::Turn
+      && getActionPre(p,f-1) == Action::Dash
+      && getActionPost(p,f) != Action::Dash
+      && (not isInHitstun(p,f))
       ;
   }
-  static inline bool isJumpHeld(const SlippiPlayer &p, const unsigned f) {
-    return p.frame[f].buttons & 0x0C00; //0000 1100 0000 0000
+  template <typename Frames>
+  static inline bool isJumpHeld(const Frames &p, const unsigned f) {
+    return getButtons(p,f) & 0x0C00; //0000 1100 0000 0000
   }
-  static inline bool didHop(const SlippiPlayer &p, const unsigned f) {
-    return p.frame[f-1].action_post == Action::KneeBend
-      && (p.frame[f].action_post == Action::JumpF || p.frame[f].action_post == Action::JumpB);
+  template <typename Frames>
+  static inline bool didHop(const Frames &p, const unsigned f) {
+    return getActionPost(p,f-1) == Action::KneeBend
+      && (getActionPost(p,f) == Action::JumpF || getActionPost(p,f) == Action::JumpB);
   }
-  static inline bool didShortHop(const SlippiPlayer &p, const unsigned f) {
+  template <typename Frames>
+  static inline bool didShortHop(const Frames &p, const unsigned f) {
     return didHop(p,f) && (not isJumpHeld(p,f));
   }
-  static inline bool didPowerShield(const SlippiPlayer &p, const unsigned f) {
-    return (p.frame[f].flags_4 & 0x20) && (not(p.frame[f-1].flags_4 & 0x20));
+  template <typename Frames>
+  static inline bool didPowerShield(const Frames &p, const unsigned f) {
+    return (getFlags4(p,f) & 0x20) && (not(getFlags4(p,f-1) & 0x20));
   }
-  static inline bool didMeteorCancel(const SlippiPlayer &p, const unsigned f) {
-    return isInHitstun(p.frame[f-1])
-      && (getHitStun(p.frame[f-1]) >= 2.0f)
-      && (!isInHitstun(p.frame[f]))
-      && (p.frame[f].action_post > Action::Wait1
-       || p.frame[f].action_post == Action::JumpAerialF
-       || p.frame[f].action_post == Action::JumpAerialB);
+  template <typename Frames>
+  static inline bool didMeteorCancel(const Frames &p, const unsigned f) {
+    return isInHitstun(p,f-1)
+      && (getHitStun(p,f-1) >= 2.0f)
+      && (!isInHitstun(p,f))
+      && (getActionPost(p,f) > Action::Wait1
+       || getActionPost(p,f) == Action::JumpAerialF
+       || getActionPost(p,f) == Action::JumpAerialB);
   }
   static inline bool didCliffCatchEnd(const SlippiPlayer &p, const unsigned f) {
     return p.frame[f-1].action_pre == Action::CliffCatch && p.frame[f].action_pre != Action::CliffCatch;
@@ -183,30 +220,36 @@ private:
         && (p.frame[f-1].action_pre == Action::Turn)
         && (p.frame[f-2].action_pre == Action::Dash);
   }
-  static inline bool isShieldBroken(const SlippiFrame &f) {
-    return f.action_pre == Action::ShieldBreakFly
-      || f.action_pre == Action::ShieldBreakFall;
+  template <typename Frames>
+  static inline bool isShieldBroken(const Frames &p, const unsigned f) {
+    return getActionPre(p,f) == Action::ShieldBreakFly
+      || getActionPre(p,f) == Action::ShieldBreakFall;
   }
   static inline bool isInJumpsquat(const SlippiFrame &f) {
     return f.action_pre == Action::KneeBend;
   }
-  static inline bool isSpotdodging(const SlippiFrame &f) {
-    return f.action_pre == Action::Escape;
+  template <typename Frames>
+  static inline bool isSpotdodging(const Frames &p, const unsigned f) {
+    return getActionPre(p,f) == Action::Escape;
   }
   static inline bool isAirdodging(const SlippiFrame &f) {
     return f.action_pre == Action::EscapeAir;
   }
-  static inline bool isGrabbing(const SlippiFrame &f) {
-    return (f.action_pre >= Action::CatchPull) && (f.action_pre <= Action::CatchAttack);
+  template <typename Frames>
+  static inline bool isGrabbing(const Frames &p, const unsigned f) {
+    return (getActionPre(p,f) >= Action::CatchPull) && (getActionPre(p,f) <= Action::CatchAttack);
   }
-  static inline bool isTaunting(const SlippiFrame &f) {
-    return (f.action_pre == Action::AppealR) || (f.action_pre == Action::AppealL);
+  template <typename Frames>
+  static inline bool isTaunting(const Frames &p, const unsigned f) {
+    return (getActionPre(p,f) == Action::AppealR) || (getActionPre(p,f) == Action::AppealL);
   }
-  static inline bool isReleasing(const SlippiFrame &f) {
-    return f.action_pre == Action::CatchCut;
+  template <typename Frames>
+  static inline bool isReleasing(const Frames &p, const unsigned f) {
+    return getActionPre(p,f) == Action::CatchCut;
   }
-  static inline bool isRolling(const SlippiFrame &f) {
-    return (f.action_pre == Action::EscapeF)|| (f.action_pre == Action::EscapeB);
+  template <typename Frames>
+  static inline bool isRolling(const Frames &p, const unsigned f) {
+    return (getActionPre(p,f) == Action::EscapeF)|| (getActionPre(p,f) == Action::EscapeB);
   }
   static inline bool isDodging(const SlippiFrame &f) {
     return (f.action_pre >= Action::EscapeF) && (f.action_pre <= Action::Escape);
@@ -234,8 +277,9 @@ private:
   static inline bool isInShield(const SlippiFrame &f) {
     return f.action_pre >= Action::GuardOn && f.action_pre <= Action::GuardReflect;
   }
-  static inline bool isInShieldstun(const SlippiFrame &f) {
-    return f.action_pre == Action::GuardSetOff;
+  template <typename Frames>
+  static inline bool isInShieldstun(const Frames &p, const unsigned f) {
+    return getActionPre(p,f) == Action::GuardSetOff;
   }
   static inline bool isGrabbed(const SlippiFrame &f) {
     return
@@ -279,11 +323,13 @@ private:
   static inline bool isInAnyWait(const SlippiFrame &f) {
     return f.action_pre == Action::Wait || ((f.action_pre >= Action::Wait1) && (f.action_pre <= Action::SquatWaitItem));
   }
-  static inline bool isOnLedge(const SlippiFrame &f) {
-    return f.action_pre == Action::CliffWait;
+  template <typename Frames>
+  static inline bool isOnLedge(const Frames &p, const unsigned f) {
+    return getActionPre(p,f) == Action::CliffWait;
   }
-  static inline bool didActionStateChange(const SlippiFrame &f) {
-    return f.action_pre != f.action_post;
+  template <typename Frames>
+  static inline bool didActionStateChange(const Frames &p, const unsigned f) {
+    return getActionPre(p,f) != getActionPost(p,f);
   }
   static inline bool isAirborne(const SlippiFrame &f) {
     return f.airborne;
@@ -294,8 +340,9 @@ private:
   static inline bool isShielding(const SlippiFrame &f) {
     return f.flags_3 & 0x80;
   }
-  static inline bool isInHitstun(const SlippiFrame &f) {
-    return f.flags_4 & 0x02;
+  template <typename Frames>
+  static inline bool isInHitstun(const Frames &p, const unsigned f) {
+    return getFlags4(p,f) & 0x02;
   }
   static inline bool isInDamageAnimation(const SlippiFrame &f) {
     return f.action_pre >= Action::DamageHi1 && f.action_pre <= Action::DamageFlyRoll;
@@ -0,0 +1,833 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+
+#ifdef __GLIBC__
+#include <malloc.h> //mallopt()
+#endif
+
+#include "util.h"
+#include "parser.h"
+#include "compressor.h"
+
+// file containing test replays
+static const std::string TESTDIR     = "test-replays";
+// normal replays
+static const std::string STANDARDDIR = "standard";
+
+typedef std::filesystem::directory_iterator f_iter;
+typedef std::chrono::steady_clock           b_clock;
+
+static int _debug = 0;
+
+namespace slip {
+
+// https://stackoverflow.com/questions/865668/how-to-parse-command-line-arguments-in-c
+char* getCmdOption(char ** begin, char ** end, const std::string & option) {
+  char ** itr = std::find(begin, end, option);
+  if (itr != end && ++itr != end) {
+    return *itr;
+  }
+  return 0;
+}
+
+bool cmdOptionExists(char** begin, char** end, const std::string& option) {
+  return std::find(begin, end, option) != end;
+}
+
+void printUsage() {
+  std::cout
+    << "Usage: slippc-bench [-b <benchmark>] [-n <iterations>] [-d <debuglevel>]:" << std::endl
+    << "  -b        Run only <benchmark> (default: all)" << std::endl
+    << "  -n        Repeat each timed operation <iterations> times (default: 5)" << std::endl
+    << "  -d        Run debug at level <debuglevel>" << std::endl
+    << std::endl
+    << "Benchmarks:" << std::endl
+    << "  load      Wall time and private memory of Parser / Compressor loads" << std::endl
+    << "  xz        Throughput of LZMA decompression into growing vs. preallocated buffers" << std::endl
+    << "  validate  Wall time of full vs. fast (in-place) validation of encoded replays" << std::endl
+    << "  shared    Wall time of parsing + encoding each replay from separate vs. shared loads" << std::endl
+    << "  analyze   Wall time of analyzing replays from row-wise vs. columnar frame data" << std::endl
+    << "  columns   Throughput of transposing event columns (shuffle / unshuffle) for compression" << std::endl
+    << "  floats    Wall time of numbering analog float values with std::map vs. a flat hash table" << std::endl
+    << "  lzma      Compression ratio and throughput of LZMA presets and thread counts on encoded replays" << std::endl
+    << "  codecs    Compression ratio and encode / decode throughput of each .zlp codec" << std::endl
+    << "  dict      Compression ratio and throughput of LZMA with vs. without a trained dictionary" << std::endl
+    << "  json      Throughput of full-frame JSON output with std::ostream vs. OutputSink number formatting" << std::endl
+    << "  columnar  Wall time and output size of full-frame JSON vs. binary columnar output" << std::endl
+    << "  reuse     Per-file overhead of fresh vs. reused (reset) Parser / Compressor instances" << std::endl
+    << "  rng       Per-seed cost of finding / replaying legacy RNG rolls by stepping vs. jumping" << std::endl
+    ;
+}
+
+//Private (anonymous) resident memory of this process in KB, or 0 if unknown
+long rssAnonKB() {
+  std::ifstream f("/proc/self/status");
+  std::string line;
+  while (std::getline(f,line)) {
+    if (line.rfind("RssAnon:",0) == 0) {
+      return std::stol(line.substr(8));
+    }
+  }
+  return 0;
+}
+
+double msSince(b_clock::time_point t) {
+  return std::chrono::duration<double,std::milli>(b_clock::now()-t).count();
+}
+
+//Decompress the standard test corpus to a scratch directory and return the
+//  list of uncompressed .slp files (sorted for stable output)
+std::vector<std::string> prepareCorpus() {
+  PATH outdir = std::filesystem::temp_directory_path() / "slippc-bench";
+  makeDirectoryIfNotExists(outdir.string().c_str());
+  std::vector<std::string> files;
+  for (const auto& entry : f_iter(PATH(TESTDIR) / PATH(STANDARDDIR))) {
+    std::string fname = entry.path().filename().string();
+    if (getFileExt(fname) != "xz") {
+      continue;
+    }
+    PATH outfile = outdir / getFileBase(fname);
+    if (!fileExists(outfile.string())) {
+      uint32_t size = 0;
+      char* buf = readFile(entry.path().string().c_str(),size);
+      std::string decomp = decompressWithLzma(buf,size);
+      delete[] buf;
+      std::ofstream o(outfile.string(), std::ios::binary | std::ios::out);
+      o.write(decomp.c_str(),decomp.size());
+      o.close();
+    }
+    files.push_back(outfile.string());
+  }
+  std::sort(files.begin(),files.end());
+  return files;
+}
+
+//Time loading every replay with the Parser and Compressor, and record how much
+//  private memory each one holds right after loading
+void benchLoad(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "load" << BLN << std::endl;
+  printf("  %-40s %8s %10s %10s %10s %10s\n","replay","KB","parse ms","parse KB","comp ms","comp KB");
+  double tot_pms = 0, tot_cms = 0;
+  long   tot_pkb = 0, tot_ckb = 0, tot_kb = 0;
+  for (const std::string& f : files) {
+    double pms = 0, cms = 0;
+    long   pkb = 0, ckb = 0;
+    for (unsigned i = 0; i < iters; ++i) {
+      long base = rssAnonKB();
+      b_clock::time_point t = b_clock::now();
+      Parser *p = new Parser(_debug);
+      p->load(f.c_str());
+      pms += msSince(t);
+      pkb  = rssAnonKB()-base;
+      delete p;
+
+      base = rssAnonKB();
+      t    = b_clock::now();
+      Compressor *c = new Compressor(_debug);
+      c->loadFromFile(f.c_str());
+      cms += msSince(t);
+      ckb  = rssAnonKB()-base;
+      delete c;
+    }
+    long kb = std::filesystem::file_size(f)/1024;
+    printf("  %-40s %8ld %10.2f %10ld %10.2f %10ld\n",
+      PATH(f).filename().string().c_str(),kb,pms/iters,pkb,cms/iters,ckb);
+    tot_pms += pms/iters; tot_cms += cms/iters;
+    tot_pkb += pkb;       tot_ckb += ckb;
+    tot_kb  += kb;
+  }
+  printf("  %-40s %8ld %10.2f %10ld %10.2f %10ld\n","TOTAL",tot_kb,tot_pms,tot_pkb,tot_cms,tot_ckb);
+}
+
+//Compare decompressing the original .xz test files by growing a string against
+//  decoding straight into a buffer sized from the stream index
+void benchDecompress(unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "xz" << BLN << std::endl;
+  double grow_ms = 0, exact_ms = 0, total_mb = 0;
+  for (const auto& entry : f_iter(PATH(TESTDIR) / PATH(STANDARDDIR))) {
+    uint32_t size = 0;
+    char* buf = readFile(entry.path().string().c_str(),size);
+    for (unsigned i = 0; i < iters; ++i) {
+      b_clock::time_point t = b_clock::now();
+      std::string decomp = decompressWithLzma(buf,size);
+      char* out = new char[decomp.size()];
+      memcpy(out,decomp.c_str(),decomp.size());
+      grow_ms += msSince(t);
+      total_mb += decomp.size()/1048576.0;
+      delete[] out;
+
+      uint32_t outlen;
+      t   = b_clock::now();
+      out = decompressWithLzma(buf,size,outlen);
+      exact_ms += msSince(t);
+      delete[] out;
+    }
+    delete[] buf;
+  }
+  printf("  %-24s %10.2f ms %10.2f MB/s\n","growing string + copy",grow_ms/iters,1000*total_mb/grow_ms);
+  printf("  %-24s %10.2f ms %10.2f MB/s\n","preallocated",exact_ms/iters,1000*total_mb/exact_ms);
+}
+
+//Time validating each encoded replay with an independent decoder against
+//  decoding in place with the encoder's own (reused) buffers
+void benchValidate(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "validate" << BLN << std::endl;
+  double full_ms = 0, fast_ms = 0;
+  for (const std::string& f : files) {
+    Compressor *c = new Compressor(_debug);
+    if (c->loadFromFile(f.c_str())) {
+      for (unsigned i = 0; i < iters; ++i) {
+        b_clock::time_point t = b_clock::now();
+        c->validate(Validate::FULL);
+        full_ms += msSince(t);
+        t = b_clock::now();
+        c->validate(Validate::FAST);
+        fast_ms += msSince(t);
+      }
+    }
+    delete c;
+  }
+  printf("  %-24s %10.2f ms\n","full",full_ms/iters);
+  printf("  %-24s %10.2f ms\n","fast",fast_ms/iters);
+}
+
+//Time parsing and encoding each replay with the Parser and Compressor each
+//  loading the file themselves against both working off of one shared load
+void benchSharedFiles(const char* label, const std::vector<std::string>& files, unsigned iters) {
+  double sep_ms = 0, shared_ms = 0;
+  for (const std::string& f : files) {
+    for (unsigned i = 0; i < iters; ++i) {
+      b_clock::time_point t = b_clock::now();
+      Parser *p = new Parser(_debug);
+      p->load(f.c_str());
+      Compressor *c = new Compressor(_debug);
+      c->loadFromFile(f.c_str());
+      sep_ms += msSince(t);
+      delete c;
+      delete p;
+
+      t = b_clock::now();
+      uint32_t size = 0;
+      bool     mapped;
+      char*    buf = loadReplayFile(f.c_str(),size,mapped);
+      p = new Parser(_debug);
+      p->loadFromSharedBuff(buf,size,f.c_str());
+      c = new Compressor(_debug);
+      c->loadFromSharedBuff(buf,size,f.c_str());
+      shared_ms += msSince(t);
+      delete c;
+      delete p;
+      unmapFile(buf,size,mapped);
+    }
+  }
+  printf("  %-12s %-24s %10.2f ms\n",label,"separate loads",sep_ms/iters);
+  printf("  %-12s %-24s %10.2f ms\n",label,"shared load",shared_ms/iters);
+}
+
+void benchShared(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "shared" << BLN << std::endl;
+  std::vector<std::string> xzfiles;
+  for (const auto& entry : f_iter(PATH(TESTDIR) / PATH(STANDARDDIR))) {
+    xzfiles.push_back(entry.path().string());
+  }
+  std::sort(xzfiles.begin(),xzfiles.end());
+  benchSharedFiles(".slp",files,iters);
+  benchSharedFiles(".slp.xz",xzfiles,iters);
+}
+
+//Time analyzing each 1v1 replay straight from its SlippiFrames against
+//  building a columnar frame store first and analyzing from that
+void benchAnalyze(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "analyze" << BLN << std::endl;
+  double aos_ms = 0, cols_ms = 0, soa_ms = 0;
+  Analyzer an(_debug);
+  for (const std::string& f : files) {
+    Parser *p = new Parser(_debug);
+    if (p->load(f.c_str())) {
+      // shallow copy so we can attach columns without touching the parser's replay
+      SlippiReplay r = *(p->replay());
+      unsigned nplayers = 0;
+      for (unsigned j = 0; j < 4; ++j) {
+        nplayers += (r.player[j].player_type != 3);
+      }
+      for (unsigned i = 0; (nplayers == 2) && (i < iters); ++i) {
+        b_clock::time_point t = b_clock::now();
+        delete an.analyze(r);
+        aos_ms += msSince(t);
+
+        t = b_clock::now();
+        r.buildColumns();
+        cols_ms += msSince(t);
+        t = b_clock::now();
+        delete an.analyze(r);
+        soa_ms += msSince(t);
+        for (unsigned j = 0; j < 8; ++j) {
+          r.player[j].cols.cleanup();
+        }
+      }
+    }
+    delete p;
+  }
+  printf("  %-24s %10.2f ms\n","row-wise",aos_ms/iters);
+  printf("  %-24s %10.2f ms (+ %.2f ms to build columns)\n","columnar",soa_ms/iters,cols_ms/iters);
+}
+
+//Column transposition as it was done before transposeColumns(): one
+//  variable-length memcpy per value, sweeping every event once per column
+void transposeColumnsBytewise(char* rows, char* cols, unsigned num_entries, const int32_t col_widths[], bool to_rows) {
+  unsigned struct_size = 0;
+  unsigned col_offsets[64];
+  for(unsigned i = 0; col_widths[i] != 0; ++i) {
+    col_offsets[i] = struct_size;
+    struct_size   += col_widths[i];
+  }
+  unsigned b = 0;
+  for(unsigned i = 0; col_widths[i] != 0; ++i) {
+    for (unsigned e = 0; e < num_entries; ++e) {
+      unsigned mempos = (e*struct_size+col_offsets[i]);
+      memcpy(to_rows ? &rows[mempos] : &cols[b], to_rows ? &cols[b] : &rows[mempos], col_widths[i]);
+      b += col_widths[i];
+    }
+  }
+}
+
+//Time transposing every replay's bytes as if they were all pre-frame or
+//  post-frame events (the cost doesn't depend on the contents)
+void benchColumns(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "columns" << BLN << std::endl;
+  typedef void (*transpose_fn)(char*, char*, unsigned, const int32_t[], bool);
+  const char*    names[2] = {"byte-wise","tiled"};
+  transpose_fn   fns[2]   = {transposeColumnsBytewise, transposeColumns};
+  const char*    evs[2]   = {"pre-frame","post-frame"};
+  const int32_t* cws[2]   = {CW_PRE, CW_POST};
+  for (unsigned v = 0; v < 2; ++v) {
+    unsigned struct_size = 0;
+    for(unsigned i = 0; cws[v][i] != 0; ++i) {
+      struct_size += cws[v][i];
+    }
+    for (unsigned k = 0; k < 2; ++k) {
+      double shuf_ms = 0, unshuf_ms = 0, total_mb = 0;
+      for (const std::string& f : files) {
+        uint32_t size = 0;
+        char*    rows = readFile(f.c_str(),size);
+        unsigned n    = size / struct_size;
+        char*    cols = new char[n*struct_size];
+        for (unsigned i = 0; i < iters; ++i) {
+          b_clock::time_point t = b_clock::now();
+          fns[k](rows,cols,n,cws[v],false);
+          shuf_ms += msSince(t);
+          t = b_clock::now();
+          fns[k](rows,cols,n,cws[v],true);
+          unshuf_ms += msSince(t);
+          total_mb += (n*struct_size)/1048576.0;
+        }
+        delete[] cols;
+        delete[] rows;
+      }
+      printf("  %-12s %-10s %10.2f MB/s shuffle %10.2f MB/s unshuffle\n",
+        evs[v],names[k],1000*total_mb/shuf_ms,1000*total_mb/unshuf_ms);
+    }
+  }
+}
+
+//Time numbering every analog stick / trigger value in each replay the way
+//  Compressor::buildFloatMap() does, with the std::maps it used to keep vs. a FloatTable
+void benchFloats(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "floats" << BLN << std::endl;
+  FloatTable table;
+  for (const std::string& f : files) {
+    Parser *p = new Parser(_debug);
+    if (!p->load(f.c_str())) {
+      delete p;
+      continue;
+    }
+    const SlippiReplay* r = p->replay();
+    std::vector<uint32_t> vals;
+    for (unsigned j = 0; j < 8; ++j) {
+      if (r->player[j].player_type == 3 || r->player[j].frame == nullptr) {
+        continue;
+      }
+      for (unsigned i = 0; i < r->frame_count; ++i) {
+        const SlippiFrame& fr = r->player[j].frame[i];
+        for (float v : {fr.joy_x, fr.joy_y, fr.c_x, fr.c_y, fr.trigger, fr.phys_l, fr.phys_r}) {
+          uint32_t bits;
+          memcpy(&bits,&v,4);
+          vals.push_back(bits);
+        }
+      }
+    }
+    delete p;
+
+    double map_ms = 0, table_ms = 0;
+    uint64_t map_sum = 0, table_sum = 0;
+    unsigned distinct = 0;
+    for (unsigned k = 0; k < iters; ++k) {
+      b_clock::time_point t = b_clock::now();
+      {
+        std::map<unsigned,unsigned> float_to_int, int_to_float, int_to_float_c;
+        unsigned num_floats = 0;
+        for (uint32_t v : vals) {
+          if (float_to_int.find(v) == float_to_int.end()) {
+            float_to_int[v]            = num_floats;
+            int_to_float[num_floats]   = v;
+            int_to_float_c[num_floats] = 1;
+            ++num_floats;
+          } else {
+            ++int_to_float_c[float_to_int[v]];
+            map_sum += float_to_int[v];
+          }
+        }
+        distinct = num_floats;
+      }
+      map_ms += msSince(t);
+
+      t = b_clock::now();
+      table.clear();
+      for (uint32_t v : vals) {
+        uint32_t num;
+        if (table.insert(v,num)) {
+          table_sum += num;
+        }
+      }
+      table_ms += msSince(t);
+    }
+    if (map_sum != table_sum || distinct != table.size()) {
+      std::cout << "  " << RED << "Mismatched float numbering for " << f << BLN << std::endl;
+    }
+    printf("  %-48s %8zu values %6u distinct %8.3f ms map %8.3f ms table\n",
+      std::filesystem::path(f).filename().string().c_str(),vals.size(),distinct,map_ms/iters,table_ms/iters);
+  }
+}
+
+//Encode (but don't compress) every replay, returning the new buffers and their total size
+std::vector<std::pair<char*,unsigned>> encodeReplays(const std::vector<std::string>& files, uint64_t &total) {
+  std::vector<std::pair<char*,unsigned>> encoded;
+  total = 0;
+  for (const std::string& f : files) {
+    Compressor *c = new Compressor(_debug);
+    if (c->loadFromFile(f.c_str())) {
+      char*    buf;
+      unsigned size = c->saveToBuff(&buf);
+      encoded.push_back({buf,size});
+      total += size;
+    }
+    delete c;
+  }
+  return encoded;
+}
+
+//Compress every encoded (pre-LZMA) replay with each combination of LZMA preset
+//  and thread count, and print the overall ratio and throughput of each
+//  (one pass only: a pass over the corpus at preset 6+ takes several seconds)
+void benchLzma(const std::vector<std::string>& files) {
+  std::cout << "----------\nBenchmark " << CYN << "lzma" << BLN << std::endl;
+  uint64_t total_in;
+  std::vector<std::pair<char*,unsigned>> encoded = encodeReplays(files,total_in);
+
+  const uint32_t presets[] = {0, 1, 3, 6, 9};
+  std::vector<unsigned> threads = {1, 2, 4};
+  unsigned hw = std::thread::hardware_concurrency();
+  if (hw > 4) {
+    threads.push_back(hw);
+  }
+  printf("  %-8s %-8s %10s %12s %12s\n","preset","threads","ratio","MB/s","out (KB)");
+  for (uint32_t preset : presets) {
+    for (unsigned t : threads) {
+      uint64_t total_out = 0;
+      b_clock::time_point start = b_clock::now();
+      for (const std::pair<char*,unsigned>& e : encoded) {
+        total_out += compressWithLzma(e.first,e.second,preset,t).size();
+      }
+      double ms = msSince(start);
+      printf("  %-8u %-8u %9.2f%% %12.2f %12.1f\n",preset,t,
+        100*(1-double(total_out)/total_in),1000*(total_in/1048576.0)/ms,total_out/1024.0);
+    }
+  }
+  for (std::pair<char*,unsigned>& e : encoded) {
+    delete[] e.first;
+  }
+}
+
+//Compress and decompress every encoded replay with each codec, and print the
+//  overall ratio and encode / decode throughput of each
+void benchCodecs(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "codecs" << BLN << std::endl;
+  uint64_t total_in;
+  std::vector<std::pair<char*,unsigned>> encoded = encodeReplays(files,total_in);
+  const char* names[2]  = {"lzma","lz"};
+  const int   codecs[2] = {Codec::LZMA, Codec::LZ};
+  printf("  %-8s %10s %14s %14s\n","codec","ratio","encode MB/s","decode MB/s");
+  for (unsigned k = 0; k < 2; ++k) {
+    uint64_t total_out = 0;
+    double   enc_ms = 0, dec_ms = 0;
+    for (const std::pair<char*,unsigned>& e : encoded) {
+      b_clock::time_point t = b_clock::now();
+      std::string comp = compressWithCodec(codecs[k],e.first,e.second);
+      enc_ms    += msSince(t);
+      total_out += comp.size();
+      for (unsigned i = 0; i < iters; ++i) {
+        uint32_t outlen;
+        t = b_clock::now();
+        char* out = decompressWithCodec(comp.c_str(),comp.size(),outlen);
+        dec_ms += msSince(t);
+        if (outlen != e.second || memcmp(out,e.first,outlen) != 0) {
+          std::cout << "  " << RED << names[k] << " failed to round-trip a replay" << BLN << std::endl;
+        }
+        delete[] out;
+      }
+    }
+    double mb = total_in/1048576.0;
+    printf("  %-8s %9.2f%% %14.2f %14.2f\n",names[k],
+      100*(1-double(total_out)/total_in),1000*mb/enc_ms,1000*mb*iters/dec_ms);
+  }
+  for (std::pair<char*,unsigned>& e : encoded) {
+    delete[] e.first;
+  }
+}
+
+//Train a dictionary on half of the encoded replays, then compress the other
+//  half with plain LZMA and with the dictionary, printing the ratio and
+//  encode / decode throughput of each, overall and for small replays only
+void benchDict(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "dict" << BLN << std::endl;
+  const unsigned SMALL = 1 << 20;  //Encoded replays smaller than this count as small
+  uint64_t total_in;
+  std::vector<std::pair<char*,unsigned>> encoded = encodeReplays(files,total_in);
+  std::vector<std::pair<const char*,size_t>> train;
+  std::vector<std::pair<char*,unsigned>>     test;
+  for (unsigned i = 0; i < encoded.size(); ++i) {
+    if (i % 2 == 0) {
+      train.push_back({encoded[i].first,encoded[i].second});
+    } else {
+      test.push_back(encoded[i]);
+    }
+  }
+  b_clock::time_point t = b_clock::now();
+  std::string data = trainDictionary(train);
+  printf("  trained %zu byte dictionary on %zu replays in %.1f ms\n",data.size(),train.size(),msSince(t));
+  std::shared_ptr<const LzmaDictionary> dict = registerDictionary(data.c_str(),data.size());
+
+  printf("  %-8s %-6s %10s %14s %14s\n","codec","set","ratio","encode MB/s","decode MB/s");
+  const char* names[2]  = {"lzma","dict"};
+  const int   codecs[2] = {Codec::LZMA, Codec::DICT};
+  for (unsigned k = 0; k < 2; ++k) {
+    uint64_t in[2] = {0}, out[2] = {0};  //All test replays, small test replays
+    double   enc_ms[2] = {0}, dec_ms[2] = {0};
+    for (const std::pair<char*,unsigned>& e : test) {
+      unsigned small = (e.second < SMALL);
+      t = b_clock::now();
+      std::string comp = compressWithCodec(codecs[k],e.first,e.second,6,1,dict.get());
+      double ems = msSince(t), dms = 0;
+      for (unsigned i = 0; i < iters; ++i) {
+        uint32_t outlen;
+        t = b_clock::now();
+        char* dec = decompressWithCodec(comp.c_str(),comp.size(),outlen);
+        dms += msSince(t);
+        if (outlen != e.second || memcmp(dec,e.first,outlen) != 0) {
+          std::cout << "  " << RED << names[k] << " failed to round-trip a replay" << BLN << std::endl;
+        }
+        delete[] dec;
+      }
+      for (unsigned j = 0; j <= small; ++j) {
+        in[j]     += e.second;
+        out[j]    += comp.size();
+        enc_ms[j] += ems;
+        dec_ms[j] += dms;
+      }
+    }
+    for (unsigned j = 0; j < 2; ++j) {
+      double mb = in[j]/1048576.0;
+      printf("  %-8s %-6s %9.2f%% %14.2f %14.2f\n",names[k],j ? "small" : "all",
+        100*(1-double(out[j])/in[j]),1000*mb/enc_ms[j],1000*mb*iters/dec_ms[j]);
+    }
+  }
+  for (std::pair<char*,unsigned>& e : encoded) {
+    delete[] e.first;
+  }
+}
+
+//Time parsing, encoding, and fully validating every replay with a fresh
+//  Parser / Compressor per file against one pair reset between files, plus
+//  the cost of getting from a loaded instance to a clean one (destroy and
+//  construct vs. reset())
+void benchReuse(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "reuse" << BLN << std::endl;
+  double fresh_ms = 0, reused_ms = 0, new_ms = 0, reset_ms = 0;
+  unsigned nfiles = 0;
+  Parser     *rp = new Parser(_debug);
+  Compressor *rc = new Compressor(_debug);
+  for (unsigned i = 0; i < iters; ++i) {
+    for (const std::string& f : files) {
+      b_clock::time_point t = b_clock::now();
+      Parser *p = new Parser(_debug);
+      p->load(f.c_str());
+      Compressor *c = new Compressor(_debug);
+      c->loadFromFile(f.c_str());
+      c->validate();
+      fresh_ms += msSince(t);
+      t = b_clock::now();
+      delete c;
+      delete p;
+      p = new Parser(_debug);
+      c = new Compressor(_debug);
+      new_ms += msSince(t);
+      delete c;
+      delete p;
+
+      t = b_clock::now();
+      rp->load(f.c_str());
+      rc->loadFromFile(f.c_str());
+      rc->validate();
+      reused_ms += msSince(t);
+      t = b_clock::now();
+      rc->reset();
+      rp->reset();
+      reset_ms += msSince(t);
+      ++nfiles;
+    }
+  }
+  delete rc;
+  delete rp;
+  printf("  %-32s %10.3f ms / file\n","fresh instances (full pass)",(fresh_ms+new_ms)/nfiles);
+  printf("  %-32s %10.3f ms / file\n","reused instances (full pass)",(reused_ms+reset_ms)/nfiles);
+  printf("  %-32s %10.2f us / file\n","destroy + construct",1000*new_ms/nfiles);
+  printf("  %-32s %10.2f us / file\n","reset()",1000*reset_ms/nfiles);
+}
+
+//JSON output as it was done before OutputSink: every key, quote, indent, and
+//  number streamed separately through std::ostream into a stringstream
+#define LJFLT(i,k,n) SPACE[ILEV*(i)] << "\"" << (k) << "\" : " << float(n)
+#define LJINT(i,k,n) SPACE[ILEV*(i)] << "\"" << (k) << "\" : " << int32_t(n)
+#define LJUIN(i,k,n) SPACE[ILEV*(i)] << "\"" << (k) << "\" : " << uint32_t(n)
+#define LJEND(a) ((a++ == 0) ? "\n" : ",\n")
+
+//Every player frame of a replay as full-frame JSON, formatted the old way
+std::string framesAsJsonLegacy(const SlippiReplay& s) {
+  std::stringstream ss;
+  for (unsigned p = 0; p < 8; ++p) {
+    if (s.player[p].frame == nullptr) {
+      continue;
+    }
+    for (unsigned f = 0; f < s.frame_count; ++f) {
+      const SlippiFrame& fr = s.player[p].frame[f];
+      ss << SPACE[ILEV*2] << "{";
+      int a = 0;
+      ss << LJEND(a) << LJUIN(2,"follower"     ,fr.follower);
+      ss << LJEND(a) << LJUIN(2,"seed"         ,fr.seed);
+      ss << LJEND(a) << LJUIN(2,"action_pre"   ,fr.action_pre);
+      ss << LJEND(a) << LJFLT(2,"pos_x_pre"    ,fr.pos_x_pre);
+      ss << LJEND(a) << LJFLT(2,"pos_y_pre"    ,fr.pos_y_pre);
+      ss << LJEND(a) << LJFLT(2,"face_dir_pre" ,fr.face_dir_pre);
+      ss << LJEND(a) << LJFLT(2,"joy_x"        ,fr.joy_x);
+      ss << LJEND(a) << LJFLT(2,"joy_y"        ,fr.joy_y);
+      ss << LJEND(a) << LJFLT(2,"c_x"          ,fr.c_x);
+      ss << LJEND(a) << LJFLT(2,"c_y"          ,fr.c_y);
+      ss << LJEND(a) << LJFLT(2,"trigger"      ,fr.trigger);
+      ss << LJEND(a) << LJUIN(2,"buttons"      ,fr.buttons);
+      ss << LJEND(a) << LJFLT(2,"phys_l"       ,fr.phys_l);
+      ss << LJEND(a) << LJFLT(2,"phys_r"       ,fr.phys_r);
+      ss << LJEND(a) << LJUIN(2,"ucf_x"        ,fr.ucf_x);
+      ss << LJEND(a) << LJFLT(2,"percent_pre"  ,fr.percent_pre);
+      ss << LJEND(a) << LJUIN(2,"char_id"      ,fr.char_id);
+      ss << LJEND(a) << LJUIN(2,"action_post"  ,fr.action_post);
+      ss << LJEND(a) << LJFLT(2,"pos_x_post"   ,fr.pos_x_post);
+      ss << LJEND(a) << LJFLT(2,"pos_y_post"   ,fr.pos_y_post);
+      ss << LJEND(a) << LJFLT(2,"face_dir_post",fr.face_dir_post);
+      ss << LJEND(a) << LJFLT(2,"percent_post" ,fr.percent_post);
+      ss << LJEND(a) << LJFLT(2,"shield"       ,fr.shield);
+      ss << LJEND(a) << LJUIN(2,"hit_with"     ,fr.hit_with);
+      ss << LJEND(a) << LJUIN(2,"combo"        ,fr.combo);
+      ss << LJEND(a) << LJUIN(2,"hurt_by"      ,fr.hurt_by);
+      ss << LJEND(a) << LJUIN(2,"stocks"       ,fr.stocks);
+      ss << LJEND(a) << LJFLT(2,"action_fc"    ,fr.action_fc);
+      ss << LJEND(a) << LJUIN(2,"flags_1"      ,fr.flags_1);
+      ss << LJEND(a) << LJUIN(2,"flags_2"      ,fr.flags_2);
+      ss << LJEND(a) << LJUIN(2,"flags_3"      ,fr.flags_3);
+      ss << LJEND(a) << LJUIN(2,"flags_4"      ,fr.flags_4);
+      ss << LJEND(a) << LJUIN(2,"flags_5"      ,fr.flags_5);
+      ss << LJEND(a) << LJUIN(2,"hitstun"      ,fr.hitstun);
+      ss << LJEND(a) << LJUIN(2,"airborne"     ,fr.airborne);
+      ss << LJEND(a) << LJUIN(2,"ground_id"    ,fr.ground_id);
+      ss << LJEND(a) << LJUIN(2,"jumps"        ,fr.jumps);
+      ss << LJEND(a) << LJUIN(2,"l_cancel"     ,fr.l_cancel);
+      ss << LJEND(a) << LJINT(2,"alive"        ,fr.alive);
+      ss << LJEND(a) << LJUIN(2,"hurtbox"      ,fr.hurtbox);
+      ss << LJEND(a) << LJFLT(2,"self_air_x"   ,fr.self_air_x);
+      ss << LJEND(a) << LJFLT(2,"self_air_y"   ,fr.self_air_y);
+      ss << LJEND(a) << LJFLT(2,"attack_x"     ,fr.attack_x);
+      ss << LJEND(a) << LJFLT(2,"attack_y"     ,fr.attack_y);
+      ss << LJEND(a) << LJFLT(2,"self_grd_x"   ,fr.self_grd_x);
+      ss << LJEND(a) << LJFLT(2,"hitlag"       ,fr.hitlag);
+      ss << LJEND(a) << LJUIN(2,"anim_index"   ,fr.anim_index);
+      ss << "\n" << SPACE[ILEV*2] << "},\n";
+    }
+  }
+  return ss.str();
+}
+
+//Time writing every replay as full-frame (-f) JSON with the old ostream
+//  formatting vs. OutputSink, as MB of JSON produced per second
+void benchJson(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "json" << BLN << std::endl;
+  double   old_ms = 0, new_ms = 0;
+  uint64_t old_bytes = 0, new_bytes = 0;
+  for (const std::string& f : files) {
+    Parser *p = new Parser(_debug);
+    if (!p->load(f.c_str())) {
+      delete p;
+      continue;
+    }
+    const SlippiReplay* r = p->replay();
+    for (unsigned i = 0; i < iters; ++i) {
+      b_clock::time_point t = b_clock::now();
+      std::string json = framesAsJsonLegacy(*r);
+      old_ms    += msSince(t);
+      old_bytes += json.size();
+
+      t = b_clock::now();
+      OutputSink out([&new_bytes](const char* data, size_t len) { new_bytes += len; });
+      r->writeJson(out,false);
+      out.close();
+      new_ms += msSince(t);
+    }
+    delete p;
+  }
+  printf("  %-24s %10.2f MB/s\n","std::ostream",1000*(old_bytes/1048576.0)/old_ms);
+  printf("  %-24s %10.2f MB/s\n","OutputSink (to_chars)",1000*(new_bytes/1048576.0)/new_ms);
+}
+
+//Time writing every replay as full-frame JSON vs. binary columnar data
+void benchColumnar(const std::vector<std::string>& files, unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "columnar" << BLN << std::endl;
+  double   json_ms = 0, cols_ms = 0;
+  uint64_t json_bytes = 0, cols_bytes = 0;
+  for (const std::string& f : files) {
+    Parser *p = new Parser(_debug);
+    if (!p->load(f.c_str())) {
+      delete p;
+      continue;
+    }
+    for (unsigned i = 0; i < iters; ++i) {
+      b_clock::time_point t = b_clock::now();
+      OutputSink jout([&json_bytes](const char* data, size_t len) { json_bytes += len; });
+      p->writeJson(jout,false);
+      jout.close();
+      json_ms += msSince(t);
+
+      t = b_clock::now();
+      OutputSink kout([&cols_bytes](const char* data, size_t len) { cols_bytes += len; });
+      p->writeColumns(kout);
+      kout.close();
+      cols_ms += msSince(t);
+    }
+    delete p;
+  }
+  unsigned n = files.size()*iters;
+  printf("  %-24s %10.2f ms / file %10.2f MB / file\n","JSON (-f)",json_ms/n,json_bytes/1048576.0/n);
+  printf("  %-24s %10.2f ms / file %10.2f MB / file\n","columnar",cols_ms/n,cols_bytes/1048576.0/n);
+}
+
+//Time the legacy RNG searches predictRNG() does for each seed it can't
+//  encode as rollback rolls: the old bounded stepping search vs. the
+//  bitwise distance, and replaying a roll count by stepping vs. jumping
+void benchRNG(unsigned iters) {
+  std::cout << "----------\nBenchmark " << CYN << "rng" << BLN << std::endl;
+  const uint32_t MAX_ROLLS = 128;
+  const unsigned N         = 1000000;
+  slip::Compressor *c = new slip::Compressor(_debug);
+  std::vector<uint32_t> seeds(N), targets(N);
+  uint32_t x = 12345;
+  for (unsigned i = 0; i < N; ++i) {
+    x = c->rollRNGLegacy(x); seeds[i]   = x;
+    x = c->rollRNGLegacy(x); targets[i] = (i % 2) ? x : c->jumpRNGLegacy(seeds[i],i % MAX_ROLLS);
+  }
+  double step_ms = 0, dist_ms = 0, replay_ms = 0, jump_ms = 0;
+  volatile uint64_t sink = 0;  //keep the loops from being optimized away
+  for (unsigned k = 0; k < iters; ++k) {
+    b_clock::time_point t = b_clock::now();
+    for (unsigned i = 0; i < N; ++i) {
+      unsigned rolls = 0;
+      for(uint32_t r = seeds[i]; (r != targets[i]) && (rolls < MAX_ROLLS); ++rolls) {
+        r = c->rollRNGLegacy(r);
+      }
+      sink += rolls;
+    }
+    step_ms += msSince(t);
+    t = b_clock::now();
+    for (unsigned i = 0; i < N; ++i) {
+      sink += c->distanceRNGLegacy(seeds[i],targets[i]);
+    }
+    dist_ms += msSince(t);
+    t = b_clock::now();
+    for (unsigned i = 0; i < N; ++i) {
+      uint32_t r = seeds[i];
+      for(unsigned j = 0; j < i % MAX_ROLLS; ++j) {
+        r = c->rollRNGLegacy(r);
+      }
+      sink += r;
+    }
+    replay_ms += msSince(t);
+    t = b_clock::now();
+    for (unsigned i = 0; i < N; ++i) {
+      sink += c->jumpRNGLegacy(seeds[i],i % MAX_ROLLS);
+    }
+    jump_ms += msSince(t);
+  }
+  delete c;
+  double per = 1000000.0/(N*(double)iters);  //ms per batch -> ns per seed
+  printf("  %-24s %10.2f ns/seed\n","find (stepping)",step_ms*per);
+  printf("  %-24s %10.2f ns/seed\n","find (distance)",dist_ms*per);
+  printf("  %-24s %10.2f ns/seed\n","replay (stepping)",replay_ms*per);
+  printf("  %-24s %10.2f ns/seed\n","replay (jump)",jump_ms*per);
+}
+
+int runbench(int argc, char** argv) {
+  if (cmdOptionExists(argv, argv+argc, "-h")) {
+    printUsage();
+    return 0;
+  }
+  char * dlevel = getCmdOption(argv, argv + argc, "-d");
+  if (dlevel) {
+    _debug = atoi(dlevel);
+  }
+  unsigned iters = 5;
+  char * n = getCmdOption(argv, argv + argc, "-n");
+  if (n) {
+    iters = std::max(1,atoi(n));
+  }
+  char * b = getCmdOption(argv, argv + argc, "-b");
+  std::string which = b ? b : "";
+
+#ifdef __GLIBC__
+  // Keep large buffers out of the heap arena so they are returned to the OS
+  //   when freed and per-replay memory deltas stay meaningful
+  mallopt(M_MMAP_THRESHOLD, 64*1024);
+#endif
+
+  std::vector<std::string> files = prepareCorpus();
+  if (which.empty() || which == "load") { benchLoad(files,iters); }
+  if (which.empty() || which == "xz")   { benchDecompress(iters); }
+  if (which.empty() || which == "validate") { benchValidate(files,iters); }
+  if (which.empty() || which == "shared")   { benchShared(files,iters); }
+  if (which.empty() || which == "analyze")  { benchAnalyze(files,iters); }
+  if (which.empty() || which == "columns")  { benchColumns(files,iters); }
+  if (which.empty() || which == "floats")   { benchFloats(files,iters); }
+  if (which.empty() || which == "lzma")     { benchLzma(files); }
+  if (which.empty() || which == "codecs")   { benchCodecs(files,iters); }
+  if (which.empty() || which == "dict")     { benchDict(files,iters); }
+  if (which.empty() || which == "json")     { benchJson(files,iters); }
+  if (which.empty() || which == "columnar") { benchColumnar(files,iters); }
+  if (which.empty() || which == "reuse")    { benchReuse(files,iters); }
+  if (which.empty() || which == "rng")      { benchRNG(iters); }
+  return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+  return slip::runbench(argc,argv);
+}
@@ -0,0 +1,378 @@
+#include "columnar.h"
+
+//Descriptor for a field of a per-frame struct
+#define FIELD(S,f) {#f, columnType<decltype(S::f)>(), sizeof(S::f), offsetof(S,f)}
+
+namespace slip {
+
+const std::vector<ColumnField> FRAME_COLUMNS = {
+  FIELD(SlippiFrame,frame),         FIELD(SlippiFrame,player),        FIELD(SlippiFrame,follower),
+  FIELD(SlippiFrame,alive),         FIELD(SlippiFrame,seed),          FIELD(SlippiFrame,action_pre),
+  FIELD(SlippiFrame,pos_x_pre),     FIELD(SlippiFrame,pos_y_pre),     FIELD(SlippiFrame,face_dir_pre),
+  FIELD(SlippiFrame,joy_x),         FIELD(SlippiFrame,joy_y),         FIELD(SlippiFrame,c_x),
+  FIELD(SlippiFrame,c_y),           FIELD(SlippiFrame,trigger),       FIELD(SlippiFrame,buttons),
+  FIELD(SlippiFrame,phys_l),        FIELD(SlippiFrame,phys_r),        FIELD(SlippiFrame,ucf_x),
+  FIELD(SlippiFrame,percent_pre),   FIELD(SlippiFrame,char_id),       FIELD(SlippiFrame,action_post),
+  FIELD(SlippiFrame,pos_x_post),    FIELD(SlippiFrame,pos_y_post),    FIELD(SlippiFrame,face_dir_post),
+  FIELD(SlippiFrame,percent_post),  FIELD(SlippiFrame,shield),        FIELD(SlippiFrame,hit_with),
+  FIELD(SlippiFrame,combo),         FIELD(SlippiFrame,hurt_by),       FIELD(SlippiFrame,stocks),
+  FIELD(SlippiFrame,action_fc),     FIELD(SlippiFrame,flags_1),       FIELD(SlippiFrame,flags_2),
+  FIELD(SlippiFrame,flags_3),       FIELD(SlippiFrame,flags_4),       FIELD(SlippiFrame,flags_5),
+  FIELD(SlippiFrame,hitstun),       FIELD(SlippiFrame,airborne),      FIELD(SlippiFrame,ground_id),
+  FIELD(SlippiFrame,jumps),         FIELD(SlippiFrame,l_cancel),      FIELD(SlippiFrame,hurtbox),
+  FIELD(SlippiFrame,self_air_x),    FIELD(SlippiFrame,self_air_y),    FIELD(SlippiFrame,attack_x),
+  FIELD(SlippiFrame,attack_y),      FIELD(SlippiFrame,self_grd_x),    FIELD(SlippiFrame,hitlag),
+  FIELD(SlippiFrame,anim_index),
+};
+
+const std::vector<ColumnField> ITEM_FRAME_COLUMNS = {
+  FIELD(SlippiItemFrame,frame),     FIELD(SlippiItemFrame,state),     FIELD(SlippiItemFrame,face_dir),
+  FIELD(SlippiItemFrame,xvel),      FIELD(SlippiItemFrame,yvel),      FIELD(SlippiItemFrame,xpos),
+  FIELD(SlippiItemFrame,ypos),      FIELD(SlippiItemFrame,damage),    FIELD(SlippiItemFrame,expire),
+  FIELD(SlippiItemFrame,flags_1),   FIELD(SlippiItemFrame,flags_2),   FIELD(SlippiItemFrame,flags_3),
+  FIELD(SlippiItemFrame,flags_4),   FIELD(SlippiItemFrame,owner),
+};
+
+void ColumnarWriter::_pad() {
+  static const char zeros[8] = {0};
+  _out.write(zeros,(8 - (_out.position() % 8)) % 8);
+}
+
+void ColumnarWriter::fileHeader() {
+  _out.write("SLPC",4);
+  write(&COLUMNAR_VERSION,4);
+}
+
+void ColumnarWriter::beginTable(const std::string& name, uint64_t rows, const std::vector<std::pair<std::string,uint8_t>>& schema) {
+  uint16_t len   = name.size();
+  uint16_t ncols = schema.size();
+  _out.write("TABL",4);
+  write(&len,2);
+  _out << name;
+  write(&rows,8);
+  write(&ncols,2);
+  for (const auto& col : schema) {
+    len = col.first.size();
+    write(&len,2);
+    _out << col.first;
+    write(&col.second,1);
+  }
+  _pad();
+}
+
+void ColumnarWriter::beginColumn(uint64_t bytes) {
+  write(&bytes,8);
+  _end = _out.position() + bytes;
+}
+
+void ColumnarWriter::endColumn() {
+  if (_out.position() != _end) {
+    _out.invalidate();  //Caller wrote the wrong number of bytes; the file is unreadable
+  }
+  _pad();
+}
+
+ColumnTable::Column& ColumnTable::_next(const char* name, uint8_t type) {
+  if (_rows == 1) {
+    _cols.push_back(Column{name,type,"",{}});
+  }
+  return _cols[_col++];
+}
+
+void ColumnTable::put(const char* name, const std::string& s) {
+  Column& c = _next(name,ColumnType::STRING);
+  if (c.offsets.empty()) {
+    c.offsets.push_back(0);
+  }
+  c.bytes.append(s);
+  c.offsets.push_back(c.bytes.size());
+}
+
+void ColumnTable::write(ColumnarWriter& w) const {
+  std::vector<std::pair<std::string,uint8_t>> schema;
+  for (const Column& c : _cols) {
+    schema.push_back({c.name,c.type});
+  }
+  w.beginTable(_name,_rows,schema);
+  for (const Column& c : _cols) {
+    uint64_t olen = c.offsets.size()*sizeof(uint32_t);
+    w.beginColumn(olen + c.bytes.size());
+    w.write(c.offsets.data(),olen);
+    w.write(c.bytes.data(),c.bytes.size());
+    w.endColumn();
+  }
+}
+
+//A run of consecutive per-frame structs exported as rows, along with the
+//  values of the per-run columns (e.g., an item's spawn ID) for those rows
+template<typename S>
+struct FrameRun {
+  const S* frames;        //First frame of the run
+  uint32_t count;         //Number of frames in the run
+  uint8_t  port     = 0;  //Port of the player (player frames only)
+  bool     follower = 0;  //Whether the player is a follower (player frames only)
+  uint32_t spawn_id = 0;  //Spawn ID of the item (item frames only)
+  uint16_t type     = 0;  //Type of the item (item frames only)
+};
+
+//Write one column's worth of values repeated once per row of each run
+template<typename T, typename S, typename F>
+void writeRunColumn(ColumnarWriter& w, const std::vector<FrameRun<S>>& runs, uint64_t rows, F value) {
+  T buf[1024];
+  w.beginColumn(rows*sizeof(T));
+  for (const FrameRun<S>& run : runs) {
+    T v = value(run);
+    std::fill(buf,buf+std::min<uint32_t>(run.count,1024),v);
+    for (uint32_t f = 0; f < run.count; f += 1024) {
+      w.write(buf,std::min<uint32_t>(run.count-f,1024)*sizeof(T));
+    }
+  }
+  w.endColumn();
+}
+
+//Gather one W-byte field of every frame of each run into a column
+template<typename S, unsigned W>
+void writeFieldColumnW(ColumnarWriter& w, const std::vector<FrameRun<S>>& runs, size_t offset) {
+  char   buf[4096];
+  size_t n = 0;
+  for (const FrameRun<S>& run : runs) {
+    const char* base = reinterpret_cast<const char*>(run.frames) + offset;
+    for (uint32_t f = 0; f < run.count; ++f) {
+      if (n + W > sizeof(buf)) {
+        w.write(buf,n);
+        n = 0;
+      }
+      memcpy(&buf[n],base + f*sizeof(S),W);
+      n += W;
+    }
+  }
+  w.write(buf,n);
+}
+
+//Write one field of every frame of each run as a column
+template<typename S>
+void writeFieldColumn(ColumnarWriter& w, const std::vector<FrameRun<S>>& runs, uint64_t rows, const ColumnField& field) {
+  w.beginColumn(rows*field.width);
+  switch (field.width) {
+    case 1: writeFieldColumnW<S,1>(w,runs,field.offset); break;
+    case 2: writeFieldColumnW<S,2>(w,runs,field.offset); break;
+    case 4: writeFieldColumnW<S,4>(w,runs,field.offset); break;
+  }
+  w.endColumn();
+}
+
+bool scanColumnarFile(const char* fname, uint64_t& valid_end, int64_t& max_game_id) {
+  valid_end   = 0;
+  max_game_id = -1;
+  FILE* f = fopen(fname,"rb");
+  if (f == nullptr) {
+    return false;
+  }
+  char     magic[4];
+  uint32_t version;
+  if (fread(magic,1,4,f) != 4 || memcmp(magic,"SLPC",4) != 0 || fread(&version,4,1,f) != 1) {
+    fclose(f);
+    return false;
+  }
+  valid_end = 8;
+  fseeko(f,0,SEEK_END);
+  uint64_t fsize = ftello(f);
+  fseeko(f,8,SEEK_SET);
+
+  //Any read that runs off the end of the file means the last table is incomplete;
+  //  a replay is only complete once the items table that ends it is
+  uint64_t pos = 8;
+  int64_t  game_id = -1;  //game_id of the replay being read
+  auto read = [&](void* dst, size_t len) {
+    pos += len;
+    return pos <= fsize && fread(dst,1,len,f) == len;
+  };
+  auto skip = [&](uint64_t len) {
+    pos += len;
+    return pos <= fsize && fseeko(f,pos,SEEK_SET) == 0;
+  };
+  while (pos < fsize) {
+    uint16_t    len, ncols;
+    uint64_t    rows;
+    uint8_t     first_type = 0;
+    std::string name;
+    if (!(read(magic,4) && memcmp(magic,"TABL",4) == 0 && read(&len,2))) {
+      break;
+    }
+    name.resize(len);
+    if (!(read(&name[0],len) && read(&rows,8) && read(&ncols,2))) {
+      break;
+    }
+    bool ok = true;
+    for (unsigned i = 0; ok && i < ncols; ++i) {
+      uint8_t type;
+      ok = read(&len,2) && skip(len) && read(&type,1);
+      if (i == 0) {
+        first_type = type;
+      }
+    }
+    ok = ok && skip((8 - (pos % 8)) % 8);
+    for (unsigned i = 0; ok && i < ncols; ++i) {
+      uint64_t bytes;
+      uint32_t id;
+      ok = read(&bytes,8);
+      if (ok && i == 0 && name == "game" && first_type == ColumnType::U32 && rows > 0 && bytes >= 4) {
+        ok = read(&id,4) && skip(bytes-4);
+        game_id = id;
+      } else {
+        ok = ok && skip(bytes);
+      }
+      ok = ok && skip((8 - (pos % 8)) % 8);
+    }
+    if (!ok) {
+      break;
+    }
+    if (name == "items") {
+      valid_end   = pos;
+      max_game_id = std::max(max_game_id,game_id);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+bool parseFieldSelection(const std::string& names, FieldSelection& sel, std::string& bad) {
+  sel = FieldSelection();
+  sel.frame[offsetof(SlippiFrame,frame)] = true;
+  size_t start = 0;
+  while (start <= names.size()) {
+    size_t end = std::min(names.find(',',start),names.size());
+    std::string name = names.substr(start,end-start);
+    start = end+1;
+    if (name.empty()) {
+      continue;
+    }
+    bool found = false;
+    for (const ColumnField& c : FRAME_COLUMNS) {
+      if (name == c.name) {
+        sel.frame[c.offset] = found = true;
+      }
+    }
+    for (const ColumnField& c : ITEM_FRAME_COLUMNS) {
+      if (name == c.name) {
+        sel.item[c.offset] = found = true;
+      }
+    }
+    if (!found) {
+      bad = name;
+      return false;
+    }
+  }
+  //Items only keep their frame numbers if at least one other item field was asked for
+  if (sel.item.any()) {
+    sel.item[offsetof(SlippiItemFrame,frame)] = true;
+  }
+  return true;
+}
+
+void writeReplayColumns(const SlippiReplay& s, ColumnarWriter& w, uint32_t game_id, const FieldSelection* fields) {
+  ColumnTable game("game");
+  game.beginRow();
+  game.put("game_id"          , game_id);
+  game.put("original_file"    , s.original_file);
+  game.put("slippi_version"   , s.slippi_version);
+  game.put("parser_version"   , s.parser_version);
+  game.put("start_time"       , s.start_time);
+  game.put("played_on"        , s.played_on);
+  game.put("match_id"         , s.match_id);
+  game.put("game_number"      , s.game_number);
+  game.put("tiebreaker_number", s.tiebreaker_number);
+  game.put("errors"           , uint32_t(s.errors));
+  game.put("frame_count"      , s.frame_count);
+  game.put("first_frame"      , s.first_frame);
+  game.put("last_frame"       , s.last_frame);
+  game.put("stage"            , s.stage);
+  game.put("seed"             , s.seed);
+  game.put("winner_id"        , s.winner_id);
+  game.put("end_type"         , s.end_type);
+  game.put("lras"             , s.lras);
+  game.put("timer"            , s.timer);
+  game.put("teams"            , s.teams);
+  game.put("items_on"         , s.items_on);
+  game.put("game_mode"        , s.game_mode);
+  game.put("pal"              , s.pal);
+  game.put("frozen_stadium"   , s.frozen_stadium);
+  game.put("language"         , s.language);
+  game.put("metadata"         , s.metadata);
+  game.write(w);
+
+  ColumnTable players("players");
+  std::vector<FrameRun<SlippiFrame>> frame_runs;
+  uint64_t frame_rows = 0;
+  for (unsigned p = 0; p < 8; ++p) {
+    if (s.player[p].frame == nullptr) {
+      continue;
+    }
+    const SlippiPlayer& pl = s.player[p % 4];  //Followers share their leader's information
+    players.beginRow();
+    players.put("game_id"     , game_id);
+    players.put("port"        , uint8_t(p % 4));
+    players.put("is_follower" , bool(p > 3));
+    players.put("ext_char_id" , pl.ext_char_id);
+    players.put("player_type" , pl.player_type);
+    players.put("start_stocks", pl.start_stocks);
+    players.put("end_stocks"  , pl.end_stocks);
+    players.put("color"       , pl.color);
+    players.put("team_id"     , pl.team_id);
+    players.put("cpu_level"   , pl.cpu_level);
+    players.put("tag_player"  , pl.tag);
+    players.put("tag_code"    , pl.tag_code);
+    players.put("tag_css"     , pl.tag_css);
+    players.put("disp_name"   , pl.disp_name);
+    players.put("slippi_uid"  , pl.slippi_uid);
+    frame_runs.push_back({s.player[p].frame,s.frame_count,uint8_t(p % 4),(p > 3)});
+    frame_rows += s.frame_count;
+  }
+  players.write(w);
+
+  //Frames not yet (or no longer) in the replay have no player / follower set,
+  //  so every frame is also tagged with the port and follower it belongs to
+  std::vector<std::pair<std::string,uint8_t>> schema = {
+    {"game_id",ColumnType::U32},{"port",ColumnType::U8},{"is_follower",ColumnType::BOOL}};
+  std::vector<ColumnField> frame_cols;
+  for (const ColumnField& c : FRAME_COLUMNS) {
+    if (fields == nullptr || fields->frame[c.offset]) {
+      frame_cols.push_back(c);
+      schema.push_back({c.name,c.type});
+    }
+  }
+  w.beginTable("frames",frame_rows,schema);
+  writeRunColumn<uint32_t>(w,frame_runs,frame_rows,[=](const FrameRun<SlippiFrame>&) { return game_id; });
+  writeRunColumn<uint8_t>(w,frame_runs,frame_rows,[](const FrameRun<SlippiFrame>& r) { return r.port; });
+  writeRunColumn<bool>(w,frame_runs,frame_rows,[](const FrameRun<SlippiFrame>& r) { return r.follower; });
+  for (const ColumnField& c : frame_cols) {
+    writeFieldColumn(w,frame_runs,frame_rows,c);
+  }
+
+  std::vector<FrameRun<SlippiItemFrame>> item_runs;
+  uint64_t item_rows = 0;
+  bool any_items = (fields == nullptr || fields->item.any());
+  for (unsigned i = 0; any_items && i < MAX_ITEMS && s.item[i].spawn_id <= MAX_ITEMS; ++i) {
+    if (s.item[i].frame != nullptr && s.item[i].num_frames > 0) {
+      item_runs.push_back({s.item[i].frame,s.item[i].num_frames,0,false,s.item[i].spawn_id,s.item[i].type});
+      item_rows += s.item[i].num_frames;
+    }
+  }
+  schema = {{"game_id",ColumnType::U32},{"spawn_id",ColumnType::U32},{"item_type",ColumnType::U16}};
+  std::vector<ColumnField> item_cols;
+  for (const ColumnField& c : ITEM_FRAME_COLUMNS) {
+    if (fields == nullptr || fields->item[c.offset]) {
+      item_cols.push_back(c);
+      schema.push_back({c.name,c.type});
+    }
+  }
+  w.beginTable("items",item_rows,schema);
+  writeRunColumn<uint32_t>(w,item_runs,item_rows,[=](const FrameRun<SlippiItemFrame>&) { return game_id; });
+  writeRunColumn<uint32_t>(w,item_runs,item_rows,[](const FrameRun<SlippiItemFrame>& r) { return r.spawn_id; });
+  writeRunColumn<uint16_t>(w,item_runs,item_rows,[](const FrameRun<SlippiItemFrame>& r) { return r.type; });
+  for (const ColumnField& c : item_cols) {
+    writeFieldColumn(w,item_runs,item_rows,c);
+  }
+}
+
+}
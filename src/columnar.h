@@ -0,0 +1,143 @@
+#ifndef COLUMNAR_H_
+#define COLUMNAR_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#include "replay.h"
+#include "sink.h"
+
+// Binary columnar export (.slpc) of replay data, for loading frame data
+//   into dataframes / arrays without going through JSON text. All integers
+//   are little-endian.
+//
+// File   : "SLPC" | u32 format version | table...
+// Table  : "TABL" | u16 name length | name | u64 row count | u16 column count
+//          | column schema... | padding | column data...
+// Schema : u16 name length | name | u8 column type (see ColumnType)
+// Data   : u64 byte length | bytes | padding
+// Padding is zeros up to the next multiple of 8 bytes in the file, so every
+//   table is a multiple of 8 bytes long and every column's bytes are 8-byte
+//   aligned.
+//
+// Fixed-width columns are row count values packed end to end. STRING columns
+//   are (row count + 1) u32 offsets into the character data that follows them
+//   (as in Arrow's utf8 layout). Tables are self-contained, so files can be
+//   concatenated (minus all but the first 8 byte header) or appended to.
+//
+// Each replay is written as four tables, all starting with a game_id column:
+//   game    : one row of game-level information
+//   players : one row per player (including Ice Climbers followers)
+//   frames  : one row per player per frame, with one column per SlippiFrame field
+//   items   : one row per item per frame, with one column per SlippiItemFrame field
+
+const uint32_t COLUMNAR_VERSION = 1;  //Format version written to .slpc files
+
+namespace ColumnType {
+  enum { U8 = 1, I8 = 2, U16 = 3, I16 = 4, U32 = 5, I32 = 6, F32 = 7, BOOL = 8, STRING = 9 };
+  const std::string name[] = { "", "u8", "i8", "u16", "i16", "u32", "i32", "f32", "bool", "string" };
+}
+
+namespace slip {
+
+//Column type used to store values of type T
+template<typename T>
+constexpr uint8_t columnType() {
+  if constexpr (std::is_same<T,bool>::value)     return ColumnType::BOOL;
+  if constexpr (std::is_same<T,uint8_t>::value)  return ColumnType::U8;
+  if constexpr (std::is_same<T,int8_t>::value)   return ColumnType::I8;
+  if constexpr (std::is_same<T,uint16_t>::value) return ColumnType::U16;
+  if constexpr (std::is_same<T,int16_t>::value)  return ColumnType::I16;
+  if constexpr (std::is_same<T,uint32_t>::value) return ColumnType::U32;
+  if constexpr (std::is_same<T,int32_t>::value)  return ColumnType::I32;
+  if constexpr (std::is_same<T,float>::value)    return ColumnType::F32;
+  return 0;
+}
+
+//A fixed-width field of a per-frame struct, exported as its own column
+struct ColumnField {
+  const char* name;    //Column name (same as the field name)
+  uint8_t     type;    //ColumnType of the field
+  uint8_t     width;   //Bytes per value
+  size_t      offset;  //Offset of the field within the struct
+};
+
+extern const std::vector<ColumnField> FRAME_COLUMNS;       //Every SlippiFrame field
+extern const std::vector<ColumnField> ITEM_FRAME_COLUMNS;  //Every SlippiItemFrame field
+
+//Writes .slpc tables to an OutputSink
+class ColumnarWriter {
+private:
+  OutputSink& _out;
+  uint64_t    _end = 0;  //Position at which the current column's bytes end
+
+  void _pad();
+public:
+  ColumnarWriter(OutputSink& out) : _out(out) {}
+
+  void fileHeader();  //Write the header at the start of a .slpc file
+  //Write a table's header and schema, to be followed by exactly one
+  //  beginColumn() ... endColumn() per column, in order
+  void beginTable(const std::string& name, uint64_t rows, const std::vector<std::pair<std::string,uint8_t>>& schema);
+  void beginColumn(uint64_t bytes);  //Start a column's data, which must total bytes bytes
+  void endColumn();                  //Finish (and pad) a column's data
+  inline void write(const void* data, size_t len) {
+    _out.write(reinterpret_cast<const char*>(data),len);
+  }
+};
+
+//A small table (e.g., game information) built up in memory one row at a
+//  time; each row must put() the same columns in the same order
+class ColumnTable {
+private:
+  struct Column {
+    std::string           name;
+    uint8_t               type;
+    std::string           bytes;    //Values (or for strings, the characters)
+    std::vector<uint32_t> offsets;  //Offsets of each string in bytes (STRING only)
+  };
+  std::string         _name;
+  uint64_t            _rows = 0;
+  unsigned            _col  = 0;  //Index of the next column put() fills in
+  std::vector<Column> _cols;
+
+  Column& _next(const char* name, uint8_t type);
+public:
+  ColumnTable(const std::string& name) : _name(name) {}
+
+  inline void beginRow() {
+    _col = 0;
+    ++_rows;
+  }
+  template<typename T>
+  inline void put(const char* name, T v) {
+    static_assert(columnType<T>() != 0, "Unsupported column type");
+    _next(name,columnType<T>()).bytes.append(reinterpret_cast<const char*>(&v),sizeof(T));
+  }
+  void put(const char* name, const std::string& s);
+  void write(ColumnarWriter& w) const;
+};
+
+//Write a replay's game, players, frames, and items tables, tagging every row
+//  with game_id (the file header is written separately with fileHeader());
+//  the frames and items tables only get columns for the selected fields (all
+//  of them if fields is null), and items get no rows if none are selected
+void writeReplayColumns(const SlippiReplay& s, ColumnarWriter& w, uint32_t game_id = 0,
+  const FieldSelection* fields = nullptr);
+
+//Select the SlippiFrame / SlippiItemFrame fields named in a comma-separated
+//  list (a name selects the field in both structs if both have it); frame
+//  numbers are always selected. Returns false and sets bad to the offending
+//  name if a name isn't a field of either struct.
+bool parseFieldSelection(const std::string& names, FieldSelection& sel, std::string& bad);
+
+//Walk the tables of an existing .slpc file, finding where its last complete
+//  replay (through its items table) ends and the highest game_id among
+//  complete replays (-1 if none); returns false if the file isn't a .slpc file
+bool scanColumnarFile(const char* fname, uint64_t& valid_end, int64_t& max_game_id);
+
+}
+
+#endif /* COLUMNAR_H_ */
@@ -1,63 +1,320 @@
 #include "compressor.h"
 
+#define JUIN(i,k,n) SPACE[ILEV*(i)] << "\"" << (k) << "\" : " << uint64_t(n)
+#define JEND(a) ((a++ == 0) ? "\n" : ",\n")
+
 namespace slip {
 
+  //Number of events transposed at a time, so each tile's events stay in
+  //  cache while all of their columns are copied
+  const unsigned TRANSPOSE_TILE = 64;
+
+  //Copy n W-byte values between a column-major block and the same field of
+  //  consecutive events stride bytes apart (W is fixed so memcpy is a single move)
+  template <unsigned W>
+  static inline void transposeColumn(char* rows, char* col, unsigned stride, unsigned n, bool to_rows) {
+    if (to_rows) {
+      for (unsigned e = 0; e < n; ++e) {
+        memcpy(&rows[e*stride],&col[e*W],W);
+      }
+    } else {
+      for (unsigned e = 0; e < n; ++e) {
+        memcpy(&col[e*W],&rows[e*stride],W);
+      }
+    }
+  }
+
+  void transposeColumns(char* rows, char* cols, unsigned num_entries, const int32_t col_widths[], bool to_rows) {
+    unsigned struct_size = 0;
+    for(unsigned i = 0; col_widths[i] != 0; ++i) {
+      struct_size += (col_widths[i] > 0) ? col_widths[i] : 1;
+    }
+
+    for (unsigned t = 0; t < num_entries; t += TRANSPOSE_TILE) {
+      unsigned n   = std::min(TRANSPOSE_TILE,num_entries-t);
+      unsigned off = 0;  //Offset of the current column within an event
+      for(unsigned i = 0; col_widths[i] != 0; ++i) {
+        int   w   = col_widths[i];
+        char* row = &rows[t*struct_size+off];
+        if (w > 0) {
+          char* col = &cols[off*num_entries+t*w];
+          switch(w) {
+            case 1: transposeColumn<1>(row,col,struct_size,n,to_rows); break;
+            case 2: transposeColumn<2>(row,col,struct_size,n,to_rows); break;
+            case 4: transposeColumn<4>(row,col,struct_size,n,to_rows); break;
+            default:
+              for (unsigned e = 0; e < n; ++e) {
+                memcpy(to_rows ? &row[e*struct_size] : &col[e*w],to_rows ? &col[e*w] : &row[e*struct_size],w);
+              }
+              break;
+          }
+        }
+        off += (w > 0) ? w : 1;
+      }
+    }
+  }
+
+  FloatTable::~FloatTable() {
+    if (_slots != nullptr)  { delete[] _slots; }
+    if (_floats != nullptr) { delete[] _floats; }
+  }
+
+  //Forget every float but keep the allocated table for the next replay
+  void FloatTable::clear() {
+    if (_size > 0) {
+      memset(_slots,0,_cap*sizeof(uint32_t));
+    }
+    _size = 0;
+  }
+
+  //Double the number of slots (starting at 1024) and rehash every float
+  void FloatTable::_grow() {
+    uint32_t* old_floats = _floats;
+    _cap    = (_cap == 0) ? 1024 : 2*_cap;
+    _floats = new uint32_t[_cap/2];
+    if (old_floats != nullptr) {
+      memcpy(_floats,old_floats,_size*sizeof(uint32_t));
+      delete[] old_floats;
+    }
+    if (_slots != nullptr) {
+      delete[] _slots;
+    }
+    _slots = new uint32_t[_cap]{0};
+    for (unsigned n = 0; n < _size; ++n) {
+      unsigned h = _hash(_floats[n]);
+      while (_slots[h] != 0) {
+        h = (h + 1) & (_cap - 1);
+      }
+      _slots[h] = n + 1;
+    }
+  }
+
+  //Name of an event in stats output
+  static std::string statsEventName(unsigned ev_code) {
+    switch(ev_code) {
+      case Event::EV_PAYLOADS: return "event_payloads";
+      case Event::GAME_START:  return "game_start";
+      case Event::PRE_FRAME:   return "pre_frame";
+      case Event::POST_FRAME:  return "post_frame";
+      case Event::GAME_END:    return "game_end";
+      case Event::FRAME_START: return "frame_start";
+      case Event::ITEM_UPDATE: return "item_update";
+      case Event::BOOKEND:     return "bookend";
+      case Event::GECKO_LIST:  return "gecko_list";
+      case Event::SPLIT_MSG:   return "split_message";
+      default:                 return "unknown_"+std::to_string(ev_code);
+    }
+  }
+
+  std::string CompressorStats::asJson() const {
+    std::stringstream ss;
+    ss << "{\n";
+    ss << JUIN(1, "input_bytes", in_size) << ",\n";
+    ss << JUIN(1, "output_bytes", out_size) << ",\n";
+    ss << JUIN(1, "blocks", blocks) << ",\n";
+
+    double total_wall = 0, total_cpu = 0;
+    ss << SPACE[ILEV] << "\"stages\" : {\n";
+    for (unsigned i = 0; i < PipelineStage::COUNT; ++i) {
+      ss << SPACE[ILEV*2] << "\"" << PipelineStage::name[i] << "\" : { "
+        << "\"wall_ms\" : " << wall_ms[i] << ", \"cpu_ms\" : " << cpu_ms[i] << " },\n";
+      total_wall += wall_ms[i];
+      total_cpu  += cpu_ms[i];
+    }
+    ss << SPACE[ILEV*2] << "\"total\" : { "
+      << "\"wall_ms\" : " << total_wall << ", \"cpu_ms\" : " << total_cpu << " }\n";
+    ss << SPACE[ILEV] << "},\n";
+
+    // Per-event byte counts are for a single encoded stream, which blocked
+    //   files don't have, so they're left out for those
+    int e = 0;
+    ss << SPACE[ILEV] << "\"events\" : {";
+    for (unsigned i = 0; i < 256 && blocks == 0; ++i) {
+      if (ev_count[i] == 0 && ev_len[i] == 0) {
+        continue;
+      }
+      ss << JEND(e) << SPACE[ILEV*2] << "\"" << statsEventName(i) << "\" : { "
+        << "\"count\" : " << ev_count[i] << ", \"raw_bytes\" : " << ev_bytes[i]
+        << ", \"shuffled_bytes\" : " << ev_len[i] << ", \"compressed_bytes\" : " << ev_comp[i] << " }";
+    }
+    ss << "\n" << SPACE[ILEV] << "},\n";
+
+    int p = 0;
+    ss << SPACE[ILEV] << "\"predictions\" : {";
+    for (unsigned i = 0; i < Predictor::COUNT; ++i) {
+      uint32_t total = preds[i]+fails[i];
+      ss << JEND(p) << SPACE[ILEV*2] << "\"" << Predictor::name[i] << "\" : { "
+        << "\"hits\" : " << preds[i] << ", \"misses\" : " << fails[i]
+        << ", \"hit_rate\" : " << (total ? double(preds[i])/total : 0.0) << " }";
+    }
+    ss << "\n" << SPACE[ILEV] << "},\n";
+
+    ss << SPACE[ILEV] << "\"rng\" : {\n";
+    ss << JUIN(2, "rollback_rolls", rng_rollback) << ",\n";
+    ss << JUIN(2, "legacy_rolls", rng_legacy) << ",\n";
+    ss << JUIN(2, "raw_seeds", rng_raw) << "\n";
+    ss << SPACE[ILEV] << "}\n";
+    ss << "}";
+    return ss.str();
+  }
+
   Compressor::Compressor(int debug_level) {
     _debug = debug_level;
-    _bp    = 0;
+    _resetState();
   }
 
   Compressor::~Compressor() {
-    if (_rb != nullptr)               { delete[] _rb; }
+    _releaseBuffers();
+    if (_validator != nullptr)        { delete   _validator; }
+    if (_vrb != nullptr)              { delete[] _vrb; }
+    if (_vwb != nullptr)              { delete[] _vwb; }
+    if (_tb != nullptr)               { delete[] _tb; }
+    if (_outfilename != nullptr)      { delete   _outfilename; }
+    if (_outgeckofilename != nullptr) { delete   _outgeckofilename; }
+  }
+
+  void Compressor::_releaseBuffers() {
+    if (!_rb_shared)                  { unmapFile(_rb,_file_size,_rb_mapped); }
     if (_wb != nullptr)               { delete[] _wb; }
+    _rb        = nullptr;
+    _wb        = nullptr;
+    _rb_mapped = false;
+    _rb_shared = false;
+  }
+
+  //Scratch buffers, the float table, and compression settings are kept, so
+  //  one compressor can encode / decode any number of replays in turn
+  void Compressor::reset() {
+    _releaseBuffers();
+    _resetState();
+    _stats      = CompressorStats();
+    _file_size  = 0;
+    _infilename = "";
+    _encode_deferred = false;
+    _blocked.clear();
+    _blocks_valid    = true;
     if (_outfilename != nullptr)      { delete   _outfilename; }
     if (_outgeckofilename != nullptr) { delete   _outgeckofilename; }
+    _outfilename      = nullptr;
+    _outgeckofilename = nullptr;
+  }
+
+  void Compressor::_resetState() {
+    memset(_payload_sizes,0,sizeof(_payload_sizes));
+    _slippi_maj       = 0;
+    _slippi_min       = 0;
+    _slippi_rev       = 0;
+    _encode_ver       = 0;
+    _max_frames       = 0;
+
+    float_map.clear();
+
+    _rng              = 0;
+    _rng_start        = 0;
+    memset(_x_pre_frame,   0,sizeof(_x_pre_frame));
+    memset(_x_pre_frame_2, 0,sizeof(_x_pre_frame_2));
+    memset(_x_post_frame,  0,sizeof(_x_post_frame));
+    memset(_x_post_frame_2,0,sizeof(_x_post_frame_2));
+    memset(_x_post_frame_3,0,sizeof(_x_post_frame_3));
+    // Item slots are handed out in spawn order, so only the first few are
+    //   ever touched by a short replay
+    memset(_x_item,        0,_item_slots_used*sizeof(_x_item[0]));
+    memset(_x_item_2,      0,_item_slots_used*sizeof(_x_item_2[0]));
+    memset(_x_item_3,      0,_item_slots_used*sizeof(_x_item_3[0]));
+    memset(_x_item_4,      0,_item_slots_used*sizeof(_x_item_4[0]));
+    memset(_x_item_p,      0,_item_slots_used*sizeof(_x_item_p[0]));
+    _item_slots_used = 0;
+
+    laststartframe       = -123;
+    lastitemstartframe   = -123;
+    lastshuffleframe     = -123;
+    lastitemshuffleframe = -123;
+    // Only the first port starts at -123; the others start at 0 (part of the encoding format)
+    for (unsigned i = 0; i < 8; ++i) {
+      lastpreframe[i]         = (i == 0) ? -123 : 0;
+      lastshufflepreframe[i]  = (i == 0) ? -123 : 0;
+      lastpostframe[i]        = (i == 0) ? -123 : 0;
+      lastshufflepostframe[i] = (i == 0) ? -123 : 0;
+    }
+
+    _bp               = 0;
+    _length_raw       = 0;
+    _length_raw_start = 0;
+    _game_loop_start  = 0;
+    _game_loop_end    = 0;
+    _message_count    = 0;
+    _game_end_found   = false;
+
+    memcpy(_cw_start,CW_START,sizeof(CW_START)); memcpy(_dw_start,CW_START,sizeof(CW_START));
+    memcpy(_cw_mesg, CW_MESG, sizeof(CW_MESG));  memcpy(_dw_mesg, CW_MESG, sizeof(CW_MESG));
+    memcpy(_cw_pre,  CW_PRE,  sizeof(CW_PRE));   memcpy(_dw_pre,  CW_PRE,  sizeof(CW_PRE));
+    memcpy(_cw_item, CW_ITEM, sizeof(CW_ITEM));  memcpy(_dw_item, CW_ITEM, sizeof(CW_ITEM));
+    memcpy(_cw_post, CW_POST, sizeof(CW_POST));  memcpy(_dw_post, CW_POST, sizeof(CW_POST));
+    memcpy(_cw_end,  CW_END,  sizeof(CW_END));   memcpy(_dw_end,  CW_END,  sizeof(CW_END));
   }
 
   bool Compressor::loadFromFile(const char* replayfilename) {
     DOUT1("  Loading " << replayfilename);
-    std::ifstream myfile;
-    myfile.open(replayfilename,std::ios::binary | std::ios::in);
-    if (myfile.fail()) {
+    // Map the file copy-on-write (decompressing it if necessary); decoding
+    //   modifies _rb in place, which only ever copies the pages actually touched
+    _rb = loadReplayFile(replayfilename,_file_size,_rb_mapped);
+    if (_rb == nullptr) {
       FAIL("    File " << replayfilename << " could not be opened or does not exist");
       return false;
     }
+    return _load(replayfilename);
+  }
+
+  bool Compressor::loadFromSharedBuff(char* buffer, uint32_t size, const char* replayfilename) {
+    DOUT1("  Loading " << replayfilename << " from shared buffer");
+    // Encoding only ever reads _rb, so the caller's buffer is used as is;
+    //   decoding unshuffles it in place, so it must not be reused afterwards
+    _rb        = buffer;
+    _file_size = size;
+    _rb_shared = true;
+    return _load(replayfilename);
+  }
 
-    myfile.seekg(0, myfile.end);
-    _file_size = myfile.tellg();
+  bool Compressor::_load(const char* replayfilename) {
     if (_file_size < MIN_REPLAY_LENGTH) {
       FAIL("    File " << replayfilename << " is too short to be a valid Slippi replay");
       return false;
     }
-    myfile.seekg(0, myfile.beg);
-
-    _rb = new char[_file_size];
-    myfile.read(_rb,_file_size);
-    myfile.close();
-
-    // Check if we have a compressed stream
-    bool is_compressed = same4(&_rb[0],LZMA_HEADER);
-    if (is_compressed) {
-      DOUT1("    File Size: " << +_file_size << ", compressed");
-      // Decompress the read buffer
-      std::string decomp = decompressWithLzma(_rb, _file_size);
-      // Get the new file size
-      _file_size    = decomp.size();
-      // Delete the old read buffer
-      delete [] _rb;
-      // Reallocate it with more spce
-      _rb = new char[_file_size];
-      // Copy buffer from the decompressed string
-      memcpy(_rb,decomp.c_str(),_file_size);
-    } else {
-      DOUT1("    File Size: " << +_file_size);
+    DOUT1("    File Size: " << +_file_size);
+
+    _infilename     = replayfilename;
+    _stats.in_size  = _file_size;
+
+    // Blocked files are decoded whole up front; there's nothing left to parse,
+    //   and saving just writes out the decoded replay
+    if (isBlocked(_rb,_file_size)) {
+      uint32_t size;
+      char*    decoded = decodeBlocked(_rb,_file_size,size);
+      if (decoded == nullptr) {
+        FAIL_CORRUPT("    Could not decode blocked file " << replayfilename);
+        return false;
+      }
+      _releaseBuffers();
+      _rb         = decoded;
+      _file_size  = size;
+      _encode_ver = COMPRETZ_VERSION;
+      _wb         = new char[_file_size];
+      memcpy(_wb,_rb,sizeof(char)*_file_size);
+      return _validating || ensureAppropriateFilename();
     }
 
-    _infilename = replayfilename;
-
     _wb           = new char[_file_size];
     memcpy(_wb,_rb,sizeof(char)*_file_size);
 
+    // Replays saved in blocks are encoded (and validated) a window at a time
+    //   by validate() or when saving, so encoding the whole replay here would
+    //   just be thrown away
+    if (_canDeferEncoding()) {
+      DOUT1("    Deferring encoding to blocks of " << _block_frames << " frames");
+      _encode_deferred = true;
+      return ensureAppropriateFilename();
+    }
+
     return this->_parse();
   }
 
@@ -67,12 +324,35 @@ namespace slip {
       return;
     }
 
+    StageTimer timer(_stats,_timed(PipelineStage::COMPRESS));
+
+    // Blocked files are built from the raw input rather than the encoded buffer
+    //   (reusing the blocks validate() already encoded, if any)
+    std::string blocked;
+    if (_block_frames > 0 && !(_encode_ver || rawencode)) {
+      blocked = _blocked.empty() ? _encodeBlocked() : std::move(_blocked);
+      _blocked.clear();
+    }
+
+    // If encoding was deferred to blocks but the replay isn't being saved in
+    //   blocks after all, encode (and validate) it as a single stream now
+    if (_encode_deferred && blocked.empty()) {
+      _encode_deferred = false;
+      if (!(this->_parse() && validate(_validate_mode))) {
+        FAIL("  Failed to encode " << _infilename);
+        return;
+      }
+    }
+
     std::ofstream ofile;
     ofile.open(*_outfilename, std::ios::binary | std::ios::out);
-    // If this is the unencoded version, compress it first
-    if (!(_encode_ver || rawencode)) {
+    if (!blocked.empty()) {
+      DOUT1("  Compression Ratio = " << float(_file_size-blocked.size())/_file_size);
+      ofile.write(blocked.c_str(),sizeof(char)*blocked.size());
+    } else if (!(_encode_ver || rawencode || _codec == Codec::NONE)) {
+      // If this is the unencoded version, compress it first
       // Compress the write buffer
-      std::string comp = compressWithLzma(_wb, _file_size);
+      std::string comp = compressWithCodec(_codec, _wb, _file_size, _lzma_preset, _lzma_threads, _dict.get());
       DOUT1("  Compression Ratio = " << float(_file_size-comp.size())/_file_size);
       // Write compressed buffer to file
       ofile.write(comp.c_str(),sizeof(char)*comp.size());
@@ -81,8 +361,13 @@ namespace slip {
       ofile.write(_wb,sizeof(char)*_file_size);
     }
 
+    _stats.out_size = ofile.tellp();
     ofile.close();
 
+    if (_stats_detail && blocked.empty() && !(_encode_ver || rawencode)) {
+      _measureEventSizes();
+    }
+
   }
 
   bool Compressor::setOutputFilename(const char* fname) {
@@ -108,6 +393,38 @@ namespace slip {
     return true;
   }
 
+  void Compressor::setLzmaOptions(uint32_t preset, unsigned threads) {
+    _lzma_preset  = preset;
+    _lzma_threads = std::max(1u,threads);
+  }
+
+  void Compressor::setCodec(int codec) {
+    _codec = codec;
+  }
+
+  void Compressor::setDictionary(std::shared_ptr<const LzmaDictionary> dict) {
+    _dict = dict;
+  }
+
+  //Compressing each event type's bytes on their own (with the same codec and
+  //  preset) shows roughly how much of the output each one accounts for
+  void Compressor::_measureEventSizes() {
+    for (unsigned ev_code = 0; ev_code < 256; ++ev_code) {
+      if (_stats.ev_len[ev_code] > 0) {
+        _stats.ev_comp[ev_code] = compressWithCodec(_codec, &_wb[_stats.ev_start[ev_code]],
+          _stats.ev_len[ev_code], _lzma_preset, _lzma_threads, _dict.get()).size();
+      }
+    }
+  }
+
+  void Compressor::setStatsDetail(bool detail) {
+    _stats_detail = detail;
+  }
+
+  const CompressorStats& Compressor::stats() const {
+    return _stats;
+  }
+
   unsigned Compressor::saveToBuff(char** buffer) {
     // buffer = new char[_file_size];
     *buffer = new char[_file_size];
@@ -124,21 +441,82 @@ namespace slip {
     return this->_parse();
   }
 
-  bool Compressor::validate() {
-    if (_encode_ver) {
+  bool Compressor::validate(int mode) {
+    _validate_mode = mode;  //Blocks encoded when saving are validated the same way
+    if (_encode_ver || mode == Validate::NONE) {
       return true;
     }
+    StageTimer timer(_stats,_timed(PipelineStage::VALIDATE));
+    if (_encode_deferred) {
+      // Encode (and validate) the blocks now, keeping them for saveToFile()
+      if (_blocked.empty()) {
+        _blocked = _encodeBlocked();
+      }
+      if (!_blocked.empty()) {
+        return _blocks_valid;
+      }
+      // Couldn't split the replay into blocks, so encode it as a single stream
+      _encode_deferred = false;
+      if (!this->_parse()) {
+        return false;
+      }
+    }
+    if (mode == Validate::FAST) {
+      return _validateInPlace();
+    }
+    return _validateWithCopy();
+  }
+
+  bool Compressor::_validateInPlace() {
+    // Hold on to the original input and our encoded output
+    char*    orig = _rb;
+    char*    enc  = _wb;
+    uint32_t size = _file_size;
+
+    // Scratch buffers for decoding are only reallocated if they're too small
+    if (_vb_size < size) {
+      if (_vrb != nullptr) { delete[] _vrb; }
+      if (_vwb != nullptr) { delete[] _vwb; }
+      _vrb     = new char[size];
+      _vwb     = new char[size];
+      _vb_size = size;
+    }
+    memcpy(_vrb,enc,sizeof(char)*size);
+    memcpy(_vwb,enc,sizeof(char)*size);
+
+    // Decode our own output as though we were loading it fresh
+    _resetState();
+    _rb         = _vrb;
+    _wb         = _vwb;
+    _validating = true;
+    bool success = this->_parse();
+    _validating = false;
+    _rb         = orig;
+    success     = success && _compareDecoded(_vwb);
+
+    // Restore our encoded output so it can still be saved
+    _wb         = enc;
+    _encode_ver = 0;
+    return success;
+  }
 
-    char *enc_buff = nullptr, *dec_buff = nullptr;
-    unsigned size  = this->saveToBuff(&enc_buff);
-    Compressor *d  = new slip::Compressor(_debug);
-    d->loadFromBuff(&enc_buff,size);
-    d->saveToBuff(&dec_buff);
+  bool Compressor::_validateWithCopy() {
+    if (_validator == nullptr) {
+      _validator = new slip::Compressor(_debug);
+    } else {
+      _validator->reset();
+    }
+    _validator->_validating = true;
+    bool success = _validator->loadFromBuff(&_wb,_file_size) && _compareDecoded(_validator->_wb);
+    _validator->_releaseBuffers();
+    return success;
+  }
 
-    bool success = (memcmp(_rb,dec_buff,size) == 0);
+  bool Compressor::_compareDecoded(const char* dec_buff) {
+    bool success = (memcmp(_rb,dec_buff,_file_size) == 0);
     if (!success) {
       unsigned diff = 0;
-      for(unsigned i = 0; i < size; ++i) {
+      for(unsigned i = 0; i < _file_size; ++i) {
         if(_rb[i] != dec_buff[i]) {
           if ((++diff) <= 500) {
             DOUT2("    Byte " << i << " differs! orig "
@@ -146,17 +524,13 @@ namespace slip {
           }
         }
       }
-      DOUT1("Differs in " << diff << "/" << size << " bytes");
+      DOUT1("Differs in " << diff << "/" << _file_size << " bytes");
     }
-
-    delete[] dec_buff;
-    delete[] enc_buff;
-    delete d;
-
     return success;
   }
 
   bool Compressor::_parse() {
+    StageTimer timer(_stats,_timed(PipelineStage::PARSE));
     _bp = 0; //Start reading from byte 0
     if (not this->_parseHeader()) {
       FAIL("  Failed to parse header");
@@ -257,6 +631,10 @@ namespace slip {
         return false;
       }
       DOUT2("    EV code " << hex(ev_code) << " encountered");
+      if (!_validating) {
+        ++_stats.ev_count[ev_code];
+        _stats.ev_bytes[ev_code] += shift;
+      }
       switch(ev_code) { //Determine the event code
         case Event::GAME_START:  success = _parseGameStart(); break;
         case Event::SPLIT_MSG:   success = _parseGeckoCodes(); break;
@@ -316,7 +694,7 @@ namespace slip {
     }
 
     // ensure we have a good output filename based on encode status
-    if (!ensureAppropriateFilename()) {
+    if ((!_validating) && (!ensureAppropriateFilename())) {
       return false;
     }
 
@@ -339,7 +717,7 @@ namespace slip {
   bool Compressor::_parseGeckoCodes() {
     if(ENCODE_VERSION_MIN(2)) {
       // Debug output for actually dumping the gecko code messages to a file
-      if(_outgeckofilename) {
+      if(_outgeckofilename && !_validating) {
         char* main_buf = (_encode_ver ? _wb : _rb);
         std::fstream fin;
         if(_message_count) {
@@ -405,6 +783,7 @@ namespace slip {
 
     //Get a storage slot for the item
     uint8_t slot = readBE4U(&_rb[_bp+O_ITEM_ID]) % ITEM_SLOTS;
+    _item_slots_used = std::max(_item_slots_used,uint32_t(slot)+1);
 
     //XOR all of the remaining data for the item
     uint16_t itype;
@@ -775,6 +1154,7 @@ namespace slip {
     if (MAX_VERSION(3,0,0)) {
         return true;
     }
+    StageTimer timer(_stats,_timed(PipelineStage::SHUFFLE_EVENTS));
 
     // Flag for if we fail anywhere
     bool success = true;
@@ -788,28 +1168,66 @@ namespace slip {
       _unshuffleColumns(main_buf);
     }
 
-    //Allocate space for storing shuffled events
-    int max_events          = ALLOC_EVENTS;  //initial number of events to allocate space for
-    unsigned offset[ETYPES] = {0};  //Size of individual event arrays
-    unsigned* ev_counts     = new unsigned[ETYPES];
-    unsigned* ev_max        = new unsigned[ETYPES];
-    unsigned* ev_size       = new unsigned[ETYPES];
-    ev_size[0]  = _payload_sizes[Event::FRAME_START];
-    ev_size[9]  = _payload_sizes[Event::ITEM_UPDATE];
-    ev_size[18] = _payload_sizes[Event::BOOKEND];
-    ev_size[19] = _payload_sizes[Event::SPLIT_MSG];
-    for (unsigned i = 0; i < 8; ++i) {
-      ev_size[1+i]  = _payload_sizes[Event::PRE_FRAME];
-      ev_size[10+i] = _payload_sizes[Event::POST_FRAME];
+    //Bin each event is shuffled into (bins from EMAX up aren't shuffled, and
+    //  frame events with an invalid player or follower byte go to the last
+    //  bin, so the size check after shuffling fails)
+    auto playerBin = [&](unsigned first, const char* ev) -> unsigned {
+      unsigned player   = uint8_t(ev[O_PLAYER]);
+      unsigned follower = uint8_t(ev[O_FOLLOWER]);
+      return (player > 3 || follower > 1) ? ETYPES-1 : first+player+4*follower;
+    };
+    auto shuffleBin = [&](unsigned ev_code, const char* ev) -> unsigned {
+      switch(ev_code) {
+        case Event::FRAME_START: return 0;
+        case Event::PRE_FRAME:   return playerBin(1,ev);
+        case Event::ITEM_UPDATE: return 9;
+        case Event::POST_FRAME:  return playerBin(10,ev);
+        case Event::BOOKEND:     return 18;
+        case Event::SPLIT_MSG:   return EMAX+1;
+        case Event::GAME_END:    return EMAX;
+        default:                 return ETYPES-1;
+      }
+    };
+
+    //Count the bytes of each type of event (and the number of frames) up front
+    //  so space for shuffling can be carved exactly from a single allocation
+    unsigned offset[ETYPES]   = {0};  //Size of individual event arrays
+    unsigned ev_bytes[ETYPES] = {0};  //Total bytes of each type of event
+    unsigned num_frames       = 0;    //Number of frame start (or bookend) events
+    unsigned num_bookends     = 0;
+    for (unsigned b = _game_loop_start; b < _game_loop_end; ) {
+      unsigned ev_code = uint8_t(main_buf[b]);
+      unsigned shift   = _payload_sizes[ev_code];
+      if (ev_code == Event::GAME_END || shift == 0) {
+        break;
+      }
+      unsigned oid = shuffleBin(ev_code,main_buf+b);
+      if (oid < EMAX) {
+        ev_bytes[oid] += shift;
+      }
+      num_frames   += (ev_code == Event::FRAME_START);
+      num_bookends += (ev_code == Event::BOOKEND);
+      b            += shift;
+    }
+    num_frames = std::max(num_frames,num_bookends)+1;
+
+    //Frame counters go first so they're aligned, then each event type's bin
+    size_t arena_size = 3*num_frames*sizeof(int);
+    for (unsigned i = 0; i < EMAX; ++i) {
+      arena_size += ev_bytes[i];
     }
-    char** ev_buf           = new char*[ETYPES];
-    for (unsigned i = 0; i < 20; ++i) {
-      ev_counts[i] = 0;          //set event counter to 0
-      ev_max[i]    = max_events; //initially allocate space for arrays
-      ev_buf[i]    = new char[ev_max[i]*ev_size[i]];
+    std::unique_ptr<char[]> arena_buf(new char[arena_size]);
+    char* arena                 = arena_buf.get();
+    int *frame_counter          = reinterpret_cast<int*>(arena);
+    unsigned *finalized_counter = reinterpret_cast<unsigned*>(frame_counter+num_frames);
+    int *dec_frames             = reinterpret_cast<int*>(finalized_counter+num_frames);
+    memset(arena,0,3*num_frames*sizeof(int));
+    char* ev_buf[EMAX];
+    char* next_bin = reinterpret_cast<char*>(dec_frames+num_frames);
+    for (unsigned i = 0; i < EMAX; ++i) {
+      ev_buf[i]  = next_bin;
+      next_bin  += ev_bytes[i];
     }
-    int *frame_counter          = new int[max_events]{0};
-    unsigned *finalized_counter = new unsigned[max_events]{0};
     unsigned start_fp           = 0;  //Frame pointer to next start frame
     unsigned end_fp             = 0;  //Frame pointer to next end frame
 
@@ -828,16 +1246,16 @@ namespace slip {
 
     //Rearrange memory
     uint8_t pid; //Temporary variable for player id
-    uint8_t oid; //Index into the offset array we're currently working with
+    unsigned oid; //Index into the offset array we're currently working with
     int cur_frame      = -125;
     unsigned oldshuffleframe = lastshuffleframe;
     for (unsigned b = _game_loop_start; b < _game_loop_end; ) {
       unsigned ev_code = uint8_t(main_buf[b]);
       unsigned shift   = _payload_sizes[ev_code];
       // std::cout << "ev code" << hex(ev_code) << " at byte " << b << "/" << _game_loop_end << std::endl;
+      oid = shuffleBin(ev_code,&main_buf[b]);
       switch(ev_code) {
         case Event::FRAME_START:
-            oid = 0;
             if (unshuffle) {
                 cur_frame        = decodeFrame(readBE4S(&main_buf[b+O_FRAME]), lastshuffleframe);
                 lastshuffleframe = cur_frame;
@@ -866,36 +1284,10 @@ namespace slip {
             frame_counter[start_fp] = cur_frame;
             ++start_fp;
 
-            // check if we've reached the event limit, and reallocate memory for more
-            //   events if so
-            if((int)start_fp == max_events) {
-              DOUT1("    Maxed out frame count, resizing to " << max_events*2 << " events");
-              // double the size of the buffer for storing frame count information
-              int* newstartbuf = new int[max_events*2];
-              // copy data from the old buffer to the new one
-              memcpy(&newstartbuf[0],&frame_counter[0],max_events);
-              // free the old frame counter buffer
-              delete[] frame_counter;
-              // set the buffer pointer to the new buffer
-              frame_counter = newstartbuf;
-
-              // double the size of the buffer for storing finalized frame information
-              unsigned* newendbuf = new unsigned[max_events*2];
-              // copy data from the old buffer to the new one
-              memcpy(&newendbuf[0],&finalized_counter[0],max_events);
-              // free the old finalized counter buffer
-              delete[] finalized_counter;
-              // set the buffer pointer to the new buffer
-              finalized_counter = newendbuf;
-
-              // actually properly double the size of the event buffer
-              max_events *= 2;
-            }
             // std::cout << "Started frame " << cur_frame << std::endl;
             break;
         case Event::PRE_FRAME: //Includes follower
             pid = uint8_t(main_buf[b+O_PLAYER])+4*uint8_t(main_buf[b+O_FOLLOWER]);
-            oid = 1+pid;
             if(!unshuffle) {
               // check if we got rollback'd into existence
               defer = (dupe_frames[modframe] - defer_pre[pid][modframe]);
@@ -911,7 +1303,6 @@ namespace slip {
             }
             break;
         case Event::ITEM_UPDATE:
-            oid = 9;
             // XOR first byte of item id with last finalized frame
             if (! unshuffle) {
               unsigned item_id = readBE4U(&main_buf[b+O_ITEM_ID]);
@@ -941,9 +1332,9 @@ namespace slip {
               } else {
                 ff = start_fp;
                 int before = 0;
-                // check last 128 frames for duplicates
+                // check last 128 frames (or as many as we've seen) for duplicates
                 // start at 2 because frame_ptr is incremented
-                for(unsigned fi = 2; fi < MAX_ROLLBACK; ++fi) {
+                for(unsigned fi = 2; fi < MAX_ROLLBACK && fi <= start_fp; ++fi) {
                   if(frame_counter[start_fp-fi] == cur_frame) {
                     before += 1;
                   }
@@ -963,7 +1354,6 @@ namespace slip {
             break;
         case Event::POST_FRAME: //Includes follower
             pid = uint8_t(main_buf[b+O_PLAYER])+4*uint8_t(main_buf[b+O_FOLLOWER]);
-            oid = 10+pid;
             if(!unshuffle) {
               // check if we got rollback'd into existence
               defer = (dupe_frames[modframe] - defer_post[pid][modframe]);
@@ -979,7 +1369,6 @@ namespace slip {
             }
             break;
         case Event::BOOKEND:
-            oid = 18;
             // Frame bookend rollback frames aren't defined before 3.7.0
             if (MIN_VERSION(3,7,0)) {
               int final_frame;
@@ -997,16 +1386,14 @@ namespace slip {
             // std::cout << "Finalized frame " << cur_frame << std::endl;
             break;
         case Event::SPLIT_MSG: //Includes follower
-            oid = EMAX+1; break;
+            break;
         case Event::GAME_END:
-            oid            = EMAX;
             _game_loop_end = b;
             // std::cout << "GAME LOOP END 0x"
             //     << std::hex << ev_code << std::dec
             //     << " at byte " << +b << std::endl;
             break;
         default:
-            oid = ETYPES-1;
             // std::cout << "NOT GOOD 0x"
             //     << std::hex << ev_code << std::dec
             //     << " at byte " << +b << std::endl;
@@ -1017,20 +1404,6 @@ namespace slip {
         //   << std::hex << ev_code << std::dec
         //   << " at byte " << +b << std::endl;
         memcpy(&ev_buf[oid][offset[oid]],&main_buf[b],sizeof(char)*shift);
-        ++(ev_counts[oid]);
-        if(ev_counts[oid] == ev_max[oid]) {
-          DOUT1("    Maxed out events for " << +oid << ", resizing to " << ev_max[oid]*2 << " events");
-          // double the size of the buffer for storing event information
-          char* newbuf = new char[ev_max[oid]*ev_size[oid]*2];
-          // copy data from the old buffer to the new one
-          memcpy(&newbuf[0],&ev_buf[oid][0],ev_max[oid]*ev_size[oid]);
-          // actually properly double the size of the event buffer
-          ev_max[oid] *= 2;
-          // free the old buffer
-          delete[] ev_buf[oid];
-          // set the buffer pointer to the new buffer
-          ev_buf[oid] = newbuf;
-        }
       }
       offset[oid] += shift;
       b           += shift;
@@ -1066,7 +1439,6 @@ namespace slip {
             _shuffleColumns(offset);
         } else { //Unshuffle into main memory, excluding message event
             unsigned cpos[EMAX] = {0};  //Buffer positions we're copying out of
-            int* dec_frames = new int[_game_loop_end];
             for(unsigned frame_ptr = 0; b < _game_loop_end; ++frame_ptr) {
                 // Sanity checks to make sure this is an actual frame start event
                 if (cpos[0] >= offset[0]) {
@@ -1243,30 +1615,361 @@ namespace slip {
                     DOUNSHUFFLE(18,Event::BOOKEND);
                 }
             }
-            delete[] dec_frames;
         }
     }
 
     //Free memory
-
-    delete[] ev_counts;
-    delete[] ev_max;
-    delete[] ev_size;
-
     for (unsigned i = 0; i < 8; ++i) {
       delete[] defer_pre[i];
       delete[] defer_post[i];
     }
     delete[] dupe_frames;
 
-    for (unsigned i = 0; i < 20; ++i) {
-        delete[] ev_buf[i];
+    return success;
+  }
+
+  //Byte offsets of the pieces of a raw replay that blocked .zlp files split apart
+  struct ReplayLayout {
+    uint16_t sizes[256] = {0};  //Payload size of each event (including its command byte)
+    uint32_t start_end  = 0;    //First byte after the game start event
+    uint32_t loop_start = 0;    //First frame event (== loop_end if there are none)
+    uint32_t loop_end   = 0;    //Game end event
+  };
+
+  //Whether an event carries a frame number at O_FRAME
+  static inline bool isFrameEvent(unsigned ev_code) {
+    switch(ev_code) {
+      case Event::FRAME_START:
+      case Event::PRE_FRAME:
+      case Event::ITEM_UPDATE:
+      case Event::POST_FRAME:
+      case Event::BOOKEND:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  //Read the payload sizes at the start of a raw replay; returns the first byte after them, or 0 on failure
+  static uint32_t readPayloadSizes(const char* buf, uint32_t size, uint16_t sizes[256]) {
+    if (size < MIN_REPLAY_LENGTH || !same8(const_cast<char*>(buf),SLP_HEADER)
+      || uint8_t(buf[N_HEADER_BYTES]) != Event::EV_PAYLOADS) {
+      return 0;
+    }
+    unsigned ev_bytes = uint8_t(buf[N_HEADER_BYTES+1])-1;
+    uint32_t b        = N_HEADER_BYTES+2;
+    if (b+ev_bytes > size) {
+      return 0;
+    }
+    memset(sizes,0,256*sizeof(uint16_t));
+    sizes[Event::EV_PAYLOADS] = ev_bytes+1;
+    for(unsigned i = 0; i+3 <= ev_bytes; i += 3) {
+      sizes[uint8_t(buf[b+i])] = readBE2U(const_cast<char*>(&buf[b+i+1]))+1;
+    }
+    for(unsigned i = Event::EV_PAYLOADS; i <= Event::GAME_END; ++i) {
+      if (sizes[i] == 0) {
+        return 0;
+      }
     }
-    delete[] ev_buf;
-    delete[] frame_counter;
-    delete[] finalized_counter;
+    return b+ev_bytes;
+  }
 
-    return success;
+  //Find where the game loop starts and ends in a raw replay
+  static bool scanLayout(const char* buf, uint32_t size, ReplayLayout &l) {
+    uint32_t b = readPayloadSizes(buf,size,l.sizes);
+    if (b == 0 || uint8_t(buf[b]) != Event::GAME_START) {
+      return false;
+    }
+    uint32_t raw_end = N_HEADER_BYTES+readBE4U(const_cast<char*>(&buf[11]));
+    if (raw_end > size) {
+      return false;
+    }
+    l.start_end  = b+l.sizes[Event::GAME_START];
+    l.loop_start = 0;
+    for (b = l.start_end; b < raw_end; b += l.sizes[uint8_t(buf[b])]) {
+      unsigned ev_code = uint8_t(buf[b]);
+      if (l.sizes[ev_code] == 0 || b+l.sizes[ev_code] > raw_end) {
+        return false;
+      }
+      if (ev_code == Event::GAME_END) {
+        l.loop_end = b;
+        if (l.loop_start == 0) {
+          l.loop_start = b;
+        }
+        return true;
+      }
+      if (l.loop_start == 0 && (ev_code == Event::FRAME_START || ev_code == Event::PRE_FRAME)) {
+        l.loop_start = b;
+      }
+    }
+    return false;  //No game end event
+  }
+
+  bool Compressor::_canDeferEncoding() {
+    ReplayLayout l;
+    if (_block_frames == 0 || _validating || _outgeckofilename != nullptr || !scanLayout(_rb,_file_size,l)) {
+      return false;
+    }
+    // Only unencoded replays from supported versions; anything else goes
+    //   through the normal parse so it's decoded or reported as usual
+    const char* gs = &_rb[l.start_end-l.sizes[Event::GAME_START]];
+    _slippi_maj = uint8_t(gs[O_SLP_MAJ]);
+    _slippi_min = uint8_t(gs[O_SLP_MIN]);
+    _slippi_rev = uint8_t(gs[O_SLP_REV]);
+    bool defer  = (gs[O_SLP_ENC] == 0) && (MAX_VERSION(3,13,0));
+    _slippi_maj = _slippi_min = _slippi_rev = 0;
+    return defer;
+  }
+
+  void Compressor::setBlockFrames(unsigned frames) {
+    _block_frames = frames;
+  }
+
+  bool Compressor::isBlocked(const char* buffer, uint32_t size) {
+    return size >= 12 && memcmp(buffer,&BLOCKED_HEADER,4) == 0
+      && memcmp(&buffer[size-4],&BLOCKED_FOOTER,4) == 0;
+  }
+
+  //Layout: the header through the game start event, then gecko messages and
+  //  anything else before the first frame, then the frames, then the game end
+  //  event and metadata. The parts outside the frames are stored raw in one
+  //  block; the frames are cut into windows of _block_frames frames, each
+  //  encoded as its own replay (the header through game start, the window,
+  //  and game end) with fresh prediction state, so it decodes on its own
+  std::string Compressor::_encodeBlocked() {
+    std::string out;
+    ReplayLayout l;
+    if (!scanLayout(_rb,_file_size,l)) {
+      WARN("  Could not find the game loop; saving as a single stream");
+      return out;
+    }
+    const unsigned GAME_END_SIZE = l.sizes[Event::GAME_END];
+    const unsigned opener        = (l.sizes[Event::FRAME_START] > 0) ? Event::FRAME_START : Event::PRE_FRAME;
+
+    out.append(reinterpret_cast<const char*>(&BLOCKED_HEADER),4);
+    std::vector<uint32_t> index;
+
+    // Everything but the frames goes in the first block, as is
+    std::string base(_rb,l.loop_start);
+    base.append(&_rb[l.loop_end],_file_size-l.loop_end);
+    std::string comp = compressWithCodec(_codec, base.c_str(), base.size(), _lzma_preset, _lzma_threads, _dict.get());
+    index.insert(index.end(),{BLOCKED_VERSION, _block_frames, _file_size, l.loop_start, l.loop_end,
+      l.start_end, uint32_t(out.size()), uint32_t(comp.size()), 0});
+    out.append(comp);
+
+    // Encode each window as a standalone replay (validating it as requested
+    //   by validate()), counting predictions for the blocks rather than any
+    //   whole-replay encoding
+    std::fill(std::begin(_stats.preds),std::end(_stats.preds),0);
+    std::fill(std::begin(_stats.fails),std::end(_stats.fails),0);
+    _stats.rng_rollback = _stats.rng_legacy = _stats.rng_raw = 0;
+    Compressor* helper = new Compressor(0);
+    char*       syn    = new char[l.start_end+(l.loop_end-l.loop_start)+GAME_END_SIZE];
+    memcpy(syn,_rb,l.start_end);
+    uint32_t nblocks = 0;
+    _blocks_valid    = true;
+    for (uint32_t w = l.loop_start; w < l.loop_end; ) {
+      // Cut the window before the first new frame at least _block_frames past its first
+      int32_t  wfirst = std::numeric_limits<int32_t>::max(), wlast = std::numeric_limits<int32_t>::min();
+      int32_t  wstart = 0, max_frame = std::numeric_limits<int32_t>::min();
+      uint32_t e      = w;
+      for (; e < l.loop_end; e += l.sizes[uint8_t(_rb[e])]) {
+        unsigned ev_code = uint8_t(_rb[e]);
+        if (!isFrameEvent(ev_code)) {
+          continue;
+        }
+        int32_t f = readBE4S(&_rb[e+O_FRAME]);
+        if (ev_code == opener && f > max_frame) {
+          if (e == w) {
+            wstart = f;
+          } else if (f - wstart >= int32_t(_block_frames)) {
+            break;
+          }
+          max_frame = f;
+        }
+        wfirst = std::min(wfirst,f);
+        wlast  = std::max(wlast,f);
+      }
+      uint32_t wsize = e-w;
+
+      uint32_t syn_size = l.start_end+wsize+GAME_END_SIZE;
+      memcpy(&syn[l.start_end],&_rb[w],wsize);
+      memcpy(&syn[l.start_end+wsize],&_rb[l.loop_end],GAME_END_SIZE);
+      writeBE4U(syn_size-N_HEADER_BYTES,&syn[11]);
+      helper->reset();
+      helper->_validating = true;
+      bool encoded = helper->loadFromBuff(&syn,syn_size) && helper->validate(_validate_mode);
+      if (encoded) {
+        comp = compressWithCodec(_codec, helper->_wb, syn_size, _lzma_preset, _lzma_threads, _dict.get());
+        for (unsigned i = 0; i < Predictor::COUNT; ++i) {
+          _stats.preds[i] += helper->_stats.preds[i];
+          _stats.fails[i] += helper->_stats.fails[i];
+        }
+        _stats.rng_rollback += helper->_stats.rng_rollback;
+        _stats.rng_legacy   += helper->_stats.rng_legacy;
+        _stats.rng_raw      += helper->_stats.rng_raw;
+      } else {
+        DOUT1("    Window at frame " << wfirst << " did not validate; storing it raw");
+        comp = compressWithCodec(_codec, &_rb[w], wsize, _lzma_preset, _lzma_threads, _dict.get());
+        _blocks_valid = false;
+      }
+      index.insert(index.end(),{uint32_t(wfirst), uint32_t(wlast), w, wsize,
+        uint32_t(out.size()), uint32_t(comp.size()), uint32_t(encoded ? BlockKind::ENCODED : BlockKind::RAW)});
+      out.append(comp);
+      ++nblocks;
+      w = e;
+    }
+    delete[] syn;
+    delete helper;
+    index[BLOCKED_INDEX_FIELDS-1] = nblocks;
+    _stats.blocks                 = nblocks;
+
+    // Index, its size, and the footer
+    index.push_back(4*index.size());
+    for (uint32_t v : index) {
+      char be[4];
+      writeBE4U(v,be);
+      out.append(be,4);
+    }
+    out.append(reinterpret_cast<const char*>(&BLOCKED_FOOTER),4);
+    DOUT1("  Encoded " << nblocks << " blocks of " << _block_frames << " frames");
+    return out;
+  }
+
+  char* Compressor::decodeBlocked(const char* buffer, uint32_t size, uint32_t &outsize, int32_t first, int32_t last) {
+    outsize = 0;
+    if (!isBlocked(buffer,size)) {
+      return nullptr;
+    }
+    char*    buf        = const_cast<char*>(buffer);
+    uint32_t index_size = readBE4U(&buf[size-8]);
+    if (index_size < 4*BLOCKED_INDEX_FIELDS || index_size > size-12) {
+      return nullptr;
+    }
+    char*    index      = &buf[size-8-index_size];
+    auto     field      = [&](unsigned i) { return readBE4U(&index[4*i]); };
+    uint32_t nblocks    = field(8);
+    uint32_t orig_size  = field(2);
+    uint32_t loop_start = field(3), loop_end = field(4), start_end = field(5);
+    // (64-bit so a huge block count can't wrap around to match the index size)
+    if (field(0) != BLOCKED_VERSION || index_size != 4*(BLOCKED_INDEX_FIELDS+BLOCKED_ENTRY_FIELDS*uint64_t(nblocks))
+      || loop_start > loop_end || loop_end > orig_size || start_end > loop_start) {
+      return nullptr;
+    }
+
+    // Decompress a block, checking it lies before the index
+    auto decompressBlock = [&](uint32_t off, uint32_t len, uint32_t &n) -> char* {
+      n = 0;
+      if (off < 4 || off > size-8-index_size || len > size-8-index_size-off) {
+        return nullptr;
+      }
+      char* out = decompressWithCodec(&buf[off],len,n);
+      if (n == 0) {
+        delete[] out;
+        return nullptr;
+      }
+      return out;
+    };
+
+    // The first block holds everything but the frames
+    uint32_t base_size;
+    char*    base = decompressBlock(field(6),field(7),base_size);
+    if (base == nullptr || base_size != loop_start+(orig_size-loop_end)) {
+      if (base != nullptr) { delete[] base; }
+      return nullptr;
+    }
+    ReplayLayout l;
+    if (readPayloadSizes(base,base_size,l.sizes) == 0) {
+      delete[] base;
+      return nullptr;
+    }
+
+    char* out = new char[orig_size];
+    memcpy(out,base,loop_start);
+    uint32_t o         = loop_start;
+    bool     success   = true;
+    bool     whole     = (first == std::numeric_limits<int32_t>::min()) && (last == std::numeric_limits<int32_t>::max());
+    Compressor* helper = nullptr;
+    for (uint32_t k = 0; success && k < nblocks; ++k) {
+      unsigned e      = BLOCKED_INDEX_FIELDS+BLOCKED_ENTRY_FIELDS*k;
+      int32_t  wfirst = int32_t(field(e)), wlast = int32_t(field(e+1));
+      uint32_t wsize  = field(e+3);
+      if (wlast < first || wfirst > last) {
+        continue;  //Only the blocks we need are ever read
+      }
+      uint32_t n;
+      char*    data = decompressBlock(field(e+4),field(e+5),n);
+      if (data == nullptr || o+wsize > orig_size) {
+        success = false;
+      } else if (field(e+6) == BlockKind::RAW) {
+        success = (n == wsize);
+        if (success) { memcpy(&out[o],data,wsize); }
+      } else {
+        if (helper == nullptr) {
+          helper = new Compressor(0);
+        } else {
+          helper->reset();
+        }
+        helper->_validating = true;
+        success = (n >= start_end+wsize) && helper->loadFromBuff(&data,n) && helper->_file_size == n;
+        if (success) { memcpy(&out[o],&helper->_wb[start_end],wsize); }
+      }
+      if (data != nullptr) { delete[] data; }
+      if (!success) {
+        break;
+      }
+
+      // Keep only events in the requested frames
+      if (whole) {
+        o += wsize;
+        continue;
+      }
+      uint32_t keep = o;
+      for (uint32_t b = o; b < o+wsize; ) {
+        unsigned ev_code = uint8_t(out[b]);
+        unsigned shift   = l.sizes[ev_code];
+        if (shift == 0 || b+shift > o+wsize) {
+          success = false;
+          break;
+        }
+        int32_t f = isFrameEvent(ev_code) ? readBE4S(&out[b+O_FRAME]) : first;
+        if (f >= first && f <= last) {
+          memmove(&out[keep],&out[b],shift);
+          keep += shift;
+        }
+        b += shift;
+      }
+      o = keep;
+    }
+    if (helper != nullptr) { delete helper; }
+
+    // Then the game end event and metadata, with the raw length fixed up to match
+    if (success) {
+      memcpy(&out[o],&base[loop_start],orig_size-loop_end);
+      outsize = o+(orig_size-loop_end);
+      writeBE4U(readBE4U(&out[11])-(orig_size-outsize),&out[11]);
+      success = whole ? (outsize == orig_size) : true;
+    }
+    delete[] base;
+    if (!success) {
+      delete[] out;
+      outsize = 0;
+      return nullptr;
+    }
+    return out;
+  }
+
+  char* Compressor::loadFrameRange(const char* replayfilename, int32_t first, int32_t last, uint32_t &outsize) {
+    outsize = 0;
+    uint32_t size;
+    bool     mapped;
+    char*    buf = mapFile(replayfilename,size,mapped);
+    if (buf == nullptr) {
+      return nullptr;
+    }
+    char* out = decodeBlocked(buf,size,outsize,first,last);
+    unmapFile(buf,size,mapped);
+    return out;
   }
 
 }
@@ -6,6 +6,7 @@
 #include <sstream>
 #include <regex>
 #include <map>
+#include <memory>
 #include <cmath>
 #include <limits>
 #include <cstdio>
@@ -33,10 +34,171 @@ const uint32_t MAX_ROLLBACK          = 128;         //Max number of frames game
 const int      RB_SIZE               = 4;           //Size of circular queue for tracking repeated frames
 
 const int      FRAME_ENC_DELTA       = 1;           //Delta when predicting and encoding next frame
-const int      ALLOC_EVENTS          = 100000;      //Number of events to initially allocate space for shuffling
+
+// Blocked (seekable) .zlp files: BLOCKED_HEADER, the compressed blocks, an
+//   index of big-endian uint32s, the index's size, then BLOCKED_FOOTER
+const uint32_t BLOCKED_HEADER        = BYTE4('Z','L','P','B');
+const uint32_t BLOCKED_FOOTER        = BYTE4('Z','L','P','I');
+const uint32_t BLOCKED_VERSION       = 1;           //Version of the blocked file index
+const unsigned BLOCKED_INDEX_FIELDS  = 9;           //Fixed fields at the start of the index
+const unsigned BLOCKED_ENTRY_FIELDS  = 7;           //Fields per block in the index
+
+// Default frame event column byte widths (negative numbers denote bit shuffling)
+const int32_t  CW_START[5]           = {1,4,4,4,0};
+const int32_t  CW_MESG[6]            = {1,512,2,1,1,0};
+const int32_t  CW_PRE[21]            = {1,4,1,1,4,2,4,4,4,4,4,4,4,4,4,2,4,4,1,4,0};
+const int32_t  CW_ITEM[21]           = {1,4,2,1,4,4,4,4,4,2,4, 1,1,1,1 ,1,1,1,1,1,0}; // Shuffle bytes of item id
+const int32_t  CW_POST[35]           = {1,4,1,1,1,2,4,4,4,4,4,1,1,1,1,4,1,1,1,1,1,4,1,2,1,1,1,4,4,4,4,4,4,4,0};
+const int32_t  CW_END[4]             = {1,4,4,0};
+
+//Levels of validation to perform after encoding / decoding a replay
+namespace Validate {
+  enum {
+    NONE = 0,  //Don't validate
+    FAST = 1,  //Decode our own output in place, reusing this compressor's buffers
+    FULL = 2,  //Decode our own output with an independent compressor
+  };
+}
+
+//How each frame window of a blocked .zlp file is stored
+namespace BlockKind {
+  enum {
+    ENCODED = 0,  //Encoded as a standalone replay (header through game start, the window, and game end)
+    RAW     = 1,  //Just the window's raw event bytes (if encoding the window fails to validate)
+  };
+}
+
+//Stages of the compression pipeline timed in CompressorStats
+namespace PipelineStage {
+  enum {
+    PARSE           = 0,  //Predictive encoding / decoding of events
+    SHUFFLE_EVENTS  = 1,  //Grouping events by type (or putting them back in order)
+    SHUFFLE_COLUMNS = 2,  //Transposing each event type's columns (or back)
+    COMPRESS        = 3,  //Compressing (and writing) the output file
+    VALIDATE        = 4,  //Decoding our own output and comparing it to the input
+    COUNT           = 5,
+  };
+  const std::string name[COUNT] = {"parse","shuffle_events","shuffle_columns","compress","validate"};
+}
+
+//Kinds of predictions whose hits and misses are counted in CompressorStats
+namespace Predictor {
+  enum {
+    VELOCITY   = 0,  //predictVeloc
+    ACCEL      = 1,  //predictAccel
+    JOLT       = 2,  //predictJolt
+    DIFFERENCE = 3,  //predictAsDifference
+    ANALOG     = 4,  //encodeAnalog
+    FLOAT_MAP  = 5,  //buildFloatMap (hit if the float was seen before)
+    COUNT      = 6,
+  };
+  const std::string name[COUNT] = {"velocity","accel","jolt","difference","analog","float_map"};
+}
 
 namespace slip {
 
+//Timings and byte counts for the last replay a Compressor encoded or decoded
+struct CompressorStats {
+  double   wall_ms[PipelineStage::COUNT] = {0};  //Wall time spent in each stage (excluding nested stages)
+  double   cpu_ms[PipelineStage::COUNT]  = {0};  //CPU time of the calling thread in each stage (excluding nested stages)
+  uint32_t ev_count[256]                 = {0};  //Number of each event parsed
+  uint64_t ev_bytes[256]                 = {0};  //Raw bytes of each event parsed
+  uint32_t ev_start[256]                 = {0};  //Start of each event's shuffled bytes in the encoded buffer
+  uint32_t ev_len[256]                   = {0};  //Length of each event's shuffled bytes in the encoded buffer
+  uint64_t ev_comp[256]                  = {0};  //Size of each event's shuffled bytes compressed on their own
+  uint32_t preds[Predictor::COUNT]       = {0};  //Successful predictions of each kind
+  uint32_t fails[Predictor::COUNT]       = {0};  //Failed predictions of each kind
+  uint32_t rng_rollback                  = 0;    //RNG seeds encoded as rollback rolls
+  uint32_t rng_legacy                    = 0;    //RNG seeds encoded as legacy rolls
+  uint32_t rng_raw                       = 0;    //RNG seeds stored raw after both roll counts failed
+  uint32_t in_size                       = 0;    //Size of the input replay
+  uint32_t out_size                      = 0;    //Size of the output file (0 if not saved)
+  uint32_t blocks                        = 0;    //Number of frame blocks in the output file (0 if not blocked)
+  int      stage                         = -1;   //Stage currently being timed (-1 for none)
+  double   mark_wall                     = 0;    //Wall time the current stage was last charged up to
+  double   mark_cpu                      = 0;    //CPU time the current stage was last charged up to
+
+  //Charge time since the last switch to the current stage, then start timing another one
+  inline void switchStage(int next) {
+    double w = wallMs(), c = threadCpuMs();
+    if (stage >= 0) {
+      wall_ms[stage] += w - mark_wall;
+      cpu_ms[stage]  += c - mark_cpu;
+    }
+    stage     = next;
+    mark_wall = w;
+    mark_cpu  = c;
+  }
+
+  std::string asJson() const;  //Convert the stats to a JSON
+};
+
+//Times a stage for as long as it's in scope, pausing whichever stage was
+//  being timed before it (does nothing for stage -1)
+class StageTimer {
+private:
+  CompressorStats &_stats;
+  int              _prev;
+  bool             _on;
+public:
+  inline StageTimer(CompressorStats &stats, int stage) : _stats(stats), _prev(stats.stage), _on(stage >= 0) {
+    if (_on) { _stats.switchStage(stage); }
+  }
+  inline ~StageTimer() {
+    if (_on) { _stats.switchStage(_prev); }
+  }
+};
+
+//Copy num_entries fixed-size events between row-major order (rows) and
+//  column-major order (cols), given each column's byte width (0-terminated);
+//  bit-shuffled (negative width) columns are skipped
+void transposeColumns(char* rows, char* cols, unsigned num_entries, const int32_t col_widths[], bool to_rows);
+
+//Open-addressing hash table numbering distinct floats (keyed on their raw
+//  bits) in order of first appearance, and mapping those numbers back
+class FloatTable {
+private:
+  uint32_t* _slots  = nullptr;  //1 + number of the float hashed to each slot, 0 if empty
+  uint32_t* _floats = nullptr;  //Raw bits of each float, by number
+  unsigned  _size   = 0;        //Number of distinct floats in the table
+  unsigned  _cap    = 0;        //Number of slots (power of 2, kept at least twice _size)
+
+  void _grow();
+
+  inline unsigned _hash(uint32_t bits) const {
+    return (bits * 2654435761u) & (_cap - 1);
+  }
+public:
+  ~FloatTable();
+  void clear();
+
+  //Look up the number for a float, adding it if it's new; returns whether it was already present
+  inline bool insert(uint32_t bits, uint32_t &num) {
+    if (2*(_size+1) > _cap) {
+      _grow();
+    }
+    for (unsigned h = _hash(bits); ; h = (h + 1) & (_cap - 1)) {
+      if (_slots[h] == 0) {
+        _floats[_size] = bits;
+        _slots[h]      = ++_size;
+        num            = _size - 1;
+        return false;
+      }
+      if (_floats[_slots[h]-1] == bits) {
+        num = _slots[h] - 1;
+        return true;
+      }
+    }
+  }
+
+  //Raw bits of the float with a given number (0 if there is no such float)
+  inline uint32_t at(uint32_t num) const {
+    return (num < _size) ? _floats[num] : 0;
+  }
+
+  inline unsigned size() const { return _size; }
+};
+
 class Compressor {
 private:
 
@@ -49,15 +211,21 @@ private:
   int32_t         _max_frames         =  0;       //Maximum number of frames that there will be in the replay file
   std::string*    _outfilename        =  nullptr; //Name of the file to write
   std::string*    _outgeckofilename   =  nullptr; //Name of gecko file to write
+  uint32_t        _lzma_preset        =  6;       //LZMA preset (0-9, optionally | LZMA_PRESET_EXTREME) for saving
+  unsigned        _lzma_threads       =  1;       //Number of threads to compress with when saving
+  int             _codec              =  Codec::LZMA; //Codec to compress with when saving
+  std::shared_ptr<const LzmaDictionary> _dict;    //Dictionary to compress with when saving with Codec::DICT
+  unsigned        _block_frames       =  0;       //Frames per block when saving a blocked .zlp (0 = one stream)
+  bool            _encode_deferred    = false;    //Whether whole-replay encoding was skipped because blocks will be encoded when saving
+  int             _validate_mode      = Validate::FAST; //Validation mode last passed to validate(), also used for each block
+  std::string     _blocked;                       //Blocked .zlp already encoded by validate(), kept for saveToFile()
+  bool            _blocks_valid       = true;     //Whether every window of the last blocked encoding validated
 
   //Variables needed for mapping floats to ints and vice versa
-  std::map<unsigned,unsigned> float_to_int;  //Map of floats to ints
-  std::map<unsigned,unsigned> int_to_float;  //Reverse map of ints back to floats
-  std::map<unsigned,unsigned> int_to_float_c;//Counter for reverse map of ints back to floats
-  unsigned            num_floats = 0;        //Total number of floats in float map
+  FloatTable      float_map;                      //Map of floats to ints and back
 
-  uint32_t        _preds = 0;
-  uint32_t        _fails = 0;
+  CompressorStats _stats;                         //Timings and byte counts for the current replay
+  bool            _stats_detail       = false;    //Whether to compress each event type on its own when saving
 
   const char*     _infilename = "";
 
@@ -73,6 +241,7 @@ private:
   char            _x_item_3[ITEM_SLOTS][256] = {0};    //Delta for item updates 3 frames ago
   char            _x_item_4[ITEM_SLOTS][256] = {0};    //Delta for item updates 4 frames ago
   char            _x_item_p[ITEM_SLOTS][256] = {0};    //Delta for item position updates
+  uint32_t        _item_slots_used           = 0;      //One past the highest item slot touched since the last reset
   int32_t         laststartframe             = -123;   //Last frame used in frame start event, encoding
   int32_t         lastitemstartframe         = -123;   //Last frame used in item event, encoding
   int32_t         lastshuffleframe           = -123;   //Last frame used in frame start event, shuffling
@@ -83,6 +252,8 @@ private:
   int32_t         lastshufflepostframe[8]    = {-123}; //Last frame used in post frame event, shuffling
 
   char*           _rb                        = nullptr; //Read buffer
+  bool            _rb_mapped                 = false;   //Whether the read buffer is a memory-mapped file
+  bool            _rb_shared                 = false;   //Whether the read buffer is owned by someone else
   char*           _wb                        = nullptr; //Write buffer
   unsigned        _bp                        = 0;       //Current position in buffer
   uint32_t        _length_raw                = 0;       //Remaining length of raw payload
@@ -93,21 +264,29 @@ private:
   uint32_t        _message_count             = 0;       //Number of gecko messages we've parsed thus far
   bool            _game_end_found            = false;   //Whether we've found the game end event
 
-  // Frame event column byte widths (negative numbers denote bit shuffling)
-  int32_t         _cw_start[5] = {1,4,4,4,0};
-  int32_t         _cw_mesg[6]  = {1,512,2,1,1,0};
-  int32_t         _cw_pre[21]  = {1,4,1,1,4,2,4,4,4,4,4,4,4,4,4,2,4,4,1,4,0};
-  int32_t         _cw_item[21] = {1,4,2,1,4,4,4,4,4,2,4, 1,1,1,1 ,1,1,1,1,1,0}; // Shuffle bytes of item id
-  int32_t         _cw_post[35] = {1,4,1,1,1,2,4,4,4,4,4,1,1,1,1,4,1,1,1,1,1,4,1,2,1,1,1,4,4,4,4,4,4,4,0};
-  int32_t         _cw_end[4]   = {1,4,4,0};
+  bool            _validating                = false;   //Whether we're decoding our own output to validate it
+  char*           _vrb                       = nullptr; //Scratch read buffer for in-place validation
+  char*           _vwb                       = nullptr; //Scratch write buffer for in-place validation
+  uint32_t        _vb_size                   = 0;       //Allocated size of validation scratch buffers
+  char*           _tb                        = nullptr; //Scratch buffer for transposing event columns
+  uint32_t        _tb_size                   = 0;       //Allocated size of column transposition scratch buffer
+  Compressor*     _validator                 = nullptr; //Compressor reused for decoding our output in full validation
+
+  // Frame event column byte widths (negative numbers denote bit shuffling), set from CW_* in _resetState()
+  int32_t         _cw_start[5];
+  int32_t         _cw_mesg[6];
+  int32_t         _cw_pre[21];
+  int32_t         _cw_item[21];
+  int32_t         _cw_post[35];
+  int32_t         _cw_end[4];
 
   // Debug Frame event column byte widths (negative numbers denote bit shuffling)
-  int32_t         _dw_start[5] = {1,4,4,4,0};
-  int32_t         _dw_mesg[6]  = {1,512,2,1,1,0};
-  int32_t         _dw_pre[21]  = {1,4,1,1,4,2,4,4,4,4,4,4,4,4,4,2,4,4,1,4,0};
-  int32_t         _dw_item[21] = {1,4,2,1,4,4,4,4,4,2,4, 1,1,1,1 ,1,1,1,1,1,0}; // Shuffle bytes of item id
-  int32_t         _dw_post[35] = {1,4,1,1,1,2,4,4,4,4,4,1,1,1,1,4,1,1,1,1,1,4,1,2,1,1,1,4,4,4,4,4,4,4,0};
-  int32_t         _dw_end[4]   = {1,4,4,0};
+  int32_t         _dw_start[5];
+  int32_t         _dw_mesg[6];
+  int32_t         _dw_pre[21];
+  int32_t         _dw_item[21];
+  int32_t         _dw_post[35];
+  int32_t         _dw_end[4];
 
   bool            _parse();             //Internal main parsing funnction
   bool            _parseHeader();
@@ -122,17 +301,55 @@ private:
   bool            _parseBookend();
   bool            _shuffleEvents(bool unshuffle = false);
   bool            _unshuffleEvents();
+  void            _resetState();        //Reset all per-replay encoding / decoding state
+  void            _releaseBuffers();    //Unmap / free the read and write buffers
+  bool            _validateInPlace();   //Decode our own output using scratch buffers
+  bool            _validateWithCopy();  //Decode our own output using a new compressor
+  bool            _compareDecoded(const char* dec_buff); //Compare decoded output to the original input
+  bool            _load(const char* replayfilename); //Copy the read buffer to the write buffer and parse it
+  std::string     _encodeBlocked();     //Build a blocked .zlp from the raw input
+  bool            _canDeferEncoding();  //Whether whole-replay encoding can be left to _encodeBlocked()
+  void            _measureEventSizes(); //Compress each event type's shuffled bytes on their own for _stats
+
+  //Time a stage (unless we're decoding our own output to validate it)
+  inline int _timed(int stage) const {
+    return _validating ? -1 : stage;
+  }
+
+  //Count a prediction made while encoding
+  inline void _countPrediction(unsigned kind, bool hit) {
+    if (hit) { ++_stats.preds[kind]; } else { ++_stats.fails[kind]; }
+  }
 
 public:
   Compressor(int debug_level);                     //Instantiate the parser (possibly in debug mode)
   ~Compressor();                                   //Destroy the parser
+  void reset();                                    //Forget the loaded replay and output filenames so another replay can be loaded
   bool loadFromFile(const char* replayfilename);   //Load a replay file
   void saveToFile(bool rawencode);              //Save an encoded replay file
   bool setOutputFilename(const char* fname);       //Set output file name
   bool setGeckoOutputFilename(const char* fname);  //Set gecko code output filename
+  void setLzmaOptions(uint32_t preset, unsigned threads); //Set LZMA preset and thread count for saving
+  void setCodec(int codec);                        //Set codec for saving
+  void setDictionary(std::shared_ptr<const LzmaDictionary> dict); //Set dictionary for saving with Codec::DICT
+  void setBlockFrames(unsigned frames);            //Save as a blocked .zlp with this many frames per block (0 = one stream)
   bool loadFromBuff(char** buffer, unsigned size); //Load a replay from a buffer
+  bool loadFromSharedBuff(char* buffer, uint32_t size, const char* replayfilename); //Load a caller-owned replay buffer without copying it
   unsigned saveToBuff(char** buffer);              //Save an encoded replay buffer
-  bool validate();                                 //Validate the encoding
+  bool validate(int mode = Validate::FULL);        //Validate the encoding
+  void setStatsDetail(bool detail);                //Also compress each event type on its own when saving, for stats()
+  const CompressorStats& stats() const;            //Timings and byte counts for the current replay
+
+  //Whether a buffer holds a blocked .zlp file
+  static bool isBlocked(const char* buffer, uint32_t size);
+  //Decode the blocks of a blocked .zlp overlapping frames first through last
+  //  into a new buffer holding a replay with just those frames (the whole
+  //  original replay by default); returns nullptr on failure
+  static char* decodeBlocked(const char* buffer, uint32_t size, uint32_t &outsize,
+    int32_t first = std::numeric_limits<int32_t>::min(), int32_t last = std::numeric_limits<int32_t>::max());
+  //Map a blocked .zlp file and decode frames first through last from it,
+  //  reading only the index and the blocks needed
+  static char* loadFrameRange(const char* replayfilename, int32_t first, int32_t last, uint32_t &outsize);
 
   //https://www.reddit.com/r/SSBM/comments/71gn1d/the_basics_of_rng_in_melee/
   inline int32_t rollRNGLegacy(int32_t seed) const {
@@ -140,6 +357,35 @@ public:
     return ((bigseed * 214013) + 2531011) % 4294967296;
   }
 
+  //Number of legacy rolls needed to get from seed to target; the LCG has full
+  //  period mod 2^32, so one always exists and can be found a bit at a time
+  //  (Brown, "Random Number Generation with Arbitrary Strides")
+  inline uint32_t distanceRNGLegacy(uint32_t seed, uint32_t target) const {
+    uint32_t mult = 214013, plus = 2531011, dist = 0;
+    for(uint32_t bit = 1; seed != target; bit <<= 1) {
+      if ((seed ^ target) & bit) {
+        seed  = (seed * mult) + plus;
+        dist |= bit;
+      }
+      plus  = (mult + 1) * plus;
+      mult *= mult;
+    }
+    return dist;
+  }
+
+  //Roll the legacy RNG n times in O(log n) steps
+  inline uint32_t jumpRNGLegacy(uint32_t seed, uint32_t n) const {
+    uint32_t mult = 214013, plus = 2531011;
+    for(; n > 0; n >>= 1) {
+      if (n & 1) {
+        seed = (seed * mult) + plus;
+      }
+      plus  = (mult + 1) * plus;
+      mult *= mult;
+    }
+    return seed;
+  }
+
   //Given the current frame's RNG value, just add 65536 to get the next frame's
   inline int32_t rollRNGRollback(int32_t seed) const {
     return (seed + 65536) % 4294967296;
@@ -193,29 +439,22 @@ public:
   //  to an index build on-the-fly
   inline void buildFloatMap(unsigned off) {
     uint32_t enc_float = readBE4U(&_rb[_bp+off]);
+    uint32_t num;
     if (_encode_ver) {                  //Decode
       if ((enc_float & MAGIC_FLOAT) != MAGIC_FLOAT) {
-        //If it's our first encounter with a float, add it to our maps
-        float_to_int[enc_float]  = num_floats;
-        int_to_float[num_floats] = enc_float;
-        ++num_floats;
+        //If it's our first encounter with a float, add it to our map
+        float_map.insert(enc_float,num);
       } else {
         //Decode our int back to a float
-        unsigned as_unsigned = int_to_float[enc_float & (MAGIC_FLOAT ^ 0xFFFFFFFF)];
-        writeBE4U(as_unsigned, &_wb[_bp+off]);
+        writeBE4U(float_map.at(enc_float & (MAGIC_FLOAT ^ 0xFFFFFFFF)), &_wb[_bp+off]);
       }
     } else {                            //Encode
-      if (float_to_int.find(enc_float) == float_to_int.end()) {
-        //If it's our first encounter with a float, add it to our maps
-        float_to_int[enc_float]    = num_floats;
-        int_to_float[num_floats]   = enc_float;
-        int_to_float_c[num_floats] = 1;
-        ++num_floats;
-      } else {
+      bool seen = float_map.insert(enc_float,num);
+      if (seen) {
         //Set the 2nd and 3rd bit, since they will never be set simultaneously in real floats
-        ++int_to_float_c[float_to_int[enc_float]];
-        writeBE4U(float_to_int[enc_float] | MAGIC_FLOAT, &_wb[_bp+off]);
+        writeBE4U(num | MAGIC_FLOAT, &_wb[_bp+off]);
       }
+      _countPrediction(Predictor::FLOAT_MAP,seen);
     }
   }
 
@@ -249,6 +488,7 @@ public:
       if (float_rest.u == float_true.u) {  //Verify we can properly decode
         writeBE4U(float_pred.u,&_wb[_bp+off]);  //Write our encoded int
       }
+      _countPrediction(Predictor::ANALOG,float_rest.u == float_true.u);
     }
   }
 
@@ -280,6 +520,7 @@ public:
       } else {
         // std::cout << "DIFF =" << float_temp.u << std::endl;
       }
+      _countPrediction(Predictor::DIFFERENCE,float_temp.u <= MAXDIFF);
     }
 
     memcpy(&buff[buffoff],&main_buf[_bp+buffoff],4);
@@ -341,6 +582,7 @@ public:
         }
         writeBE4U(MAGIC_FLOAT ^ float_temp.u,&_wb[_bp+off]);  //Write an impossible float
       }
+      _countPrediction(Predictor::JOLT,float_temp.u <= MAXDIFF);
     }
 
     memcpy(&buff4[off], &buff3[off],4);
@@ -394,6 +636,7 @@ public:
       if (float_temp.u <= MAXDIFF) {
         writeBE4U(MAGIC_FLOAT ^ float_temp.u,&_wb[_bp+off]);  //Write an impossible float
       }
+      _countPrediction(Predictor::ACCEL,float_temp.u <= MAXDIFF);
     }
 
     memcpy(&buff3[off], &buff2[off],4);
@@ -418,6 +661,7 @@ public:
       if (float_temp.u == 0) {  //If our prediction was exactly accurate
         writeBE4U(MAGIC_FLOAT,&_wb[_bp+off]);  //Write an impossible float
       }
+      _countPrediction(Predictor::VELOCITY,float_temp.u == 0);
     }
 
     memcpy(&buff2[off], &buff1[off],4);
@@ -484,58 +728,51 @@ public:
         if (rng_is_raw == 0) { //Roll RNG a few times until we get to the desired value
           unsigned rolls = readBE4U(&_rb[_bp+rngoff]);
           if (rolls < MAX_ROLLS) {
-            for(unsigned i = 0; i < rolls; ++i) {
-              _rng = rollRNGRollback(_rng);
-            }
+            _rng += rolls << 16;  //Each rollback roll adds 65536
           } else {  //Fallback on old RNG rolling method
-            for(unsigned i = MAX_ROLLS; i < rolls; ++i) {
-              _rng = rollRNGLegacy(_rng);
-            }
+            _rng = jumpRNGLegacy(_rng, rolls - MAX_ROLLS);
           }
           writeBE4U(_rng,&_wb[_bp+rngoff]);
         } else {
           writeBE4U(frame,&_wb[_bp+frameoff]);
         }
       } else {  //Encode
-        unsigned rolls  = 0;
         unsigned target = readBE4U(&_rb[_bp+rngoff]);
-        for(uint32_t start_rng = _rng; (start_rng != target) && (rolls < MAX_ROLLS); ++rolls) {
-          start_rng = rollRNGRollback(start_rng);
-        }
+        //Rollback rolls only reach seeds a multiple of 65536 away
+        uint32_t delta  = target - _rng;
+        unsigned rolls  = (delta & 0xFFFF) ? MAX_ROLLS : std::min(delta >> 16, MAX_ROLLS);
         if (rolls < MAX_ROLLS) {  //If we can encode RNG as < 256 rolls, do it
           // std::cout << "Rollback rolled " << rolls << " at byte " << _bp << " frame " << frame << std::endl;
           writeBE4U(rolls,&_wb[_bp+rngoff]);
           _rng = target;
+          ++_stats.rng_rollback;
         } else {
-          rolls  = 0;
-          for(uint32_t start_rng = _rng; (start_rng != target) && (rolls < MAX_ROLLS); ++rolls) {
-            start_rng = rollRNGLegacy(start_rng);
-          }
+          rolls = distanceRNGLegacy(_rng, target);
           if (rolls < MAX_ROLLS) {
             // std::cout << "Legacy rolled " << rolls << " at byte " << _bp << " frame " << frame << std::endl;
             writeBE4U(rolls+MAX_ROLLS,&_wb[_bp+rngoff]);
+            ++_stats.rng_legacy;
           } else { //Store the raw RNG value
             // std::cout << "Legacy failed at byte " << _bp << " frame " << frame << std::endl;
             //Load the predicted frame value
             int32_t predicted_frame = readBE4S(&_wb[_bp+frameoff]);
             //Flip second bit of cached frame number to signal raw rng
             writeBE4S(predicted_frame ^ RAW_RNG_MASK,&_wb[_bp+frameoff]);
+            ++_stats.rng_raw;
           }
         }
       }
     } else { //Old RNG
       if (_encode_ver) {
         unsigned rolls = readBE4U(&_rb[_bp+rngoff]);
-        for(unsigned i = 0; i < rolls; ++i) {
-          _rng = rollRNGLegacy(_rng);
-        }
+        _rng = jumpRNGLegacy(_rng, rolls);
         writeBE4U(_rng,&_wb[_bp+rngoff]);
-      } else { //Roll RNG until we hit the target, write the # of rolls
-        unsigned rolls, seed = readBE4U(&_rb[_bp+rngoff]);
-        for(rolls = 0; _rng != seed; ++rolls) {
-          _rng = rollRNGLegacy(_rng);
-        }
+      } else { //Find how many rolls it takes to hit the target, write the # of rolls
+        unsigned seed  = readBE4U(&_rb[_bp+rngoff]);
+        unsigned rolls = distanceRNGLegacy(_rng, seed);
+        _rng = seed;
         writeBE4U(rolls,&_wb[_bp+rngoff]);
+        ++_stats.rng_legacy;
       }
     }
   }
@@ -737,7 +974,16 @@ public:
     return _shuffleItems(iblock_start, iblock_len, false);
   }
 
+  //Record where an event type's shuffled bytes landed in the encoded buffer
+  inline void _markShuffled(unsigned ev_code, unsigned start, unsigned len) {
+    if (_stats.ev_len[ev_code] == 0) {
+      _stats.ev_start[ev_code] = start;
+    }
+    _stats.ev_len[ev_code] += len;
+  }
+
   inline bool _shuffleColumns(unsigned *offset) {
+      StageTimer timer(_stats,_timed(PipelineStage::SHUFFLE_COLUMNS));
       truncateColumnWidthsToVersion();
       char* main_buf = _wb;
 
@@ -749,6 +995,7 @@ public:
       if (main_buf[s] == Event::SPLIT_MSG) {
         *mem_size = offset[19];
         _transposeEventColumns(main_buf,s,mem_size,_debug ? this->_dw_mesg : this->_cw_mesg,false);
+        _markShuffled(Event::SPLIT_MSG,s,*mem_size);
         s += *mem_size;
       }
 
@@ -756,6 +1003,7 @@ public:
       if (main_buf[s] == Event::FRAME_START) {
         *mem_size = offset[0];
         _transposeEventColumns(main_buf,s,mem_size,_debug ? this->_dw_start : this->_cw_start,false);
+        _markShuffled(Event::FRAME_START,s,*mem_size);
         s += *mem_size;
       }
 
@@ -771,6 +1019,7 @@ public:
             continue;
           }
           _transposeEventColumns(main_buf,s,mem_size,_debug ? this->_dw_pre : this->_cw_pre,false);
+          _markShuffled(Event::PRE_FRAME,s,*mem_size);
           s += *mem_size;
       }
 
@@ -782,6 +1031,7 @@ public:
           _shuffleItems(&main_buf[s],*mem_size);
         }
         _transposeEventColumns(main_buf,s,mem_size,_debug ? this->_dw_item : this->_cw_item,false);
+        _markShuffled(Event::ITEM_UPDATE,s,*mem_size);
         s += *mem_size;
       }
 
@@ -797,6 +1047,7 @@ public:
             continue;
           }
           _transposeEventColumns(main_buf,s,mem_size,_debug ? this->_dw_post : this->_cw_post,false);
+          _markShuffled(Event::POST_FRAME,s,*mem_size);
           s += *mem_size;
       }
 
@@ -804,6 +1055,7 @@ public:
       if (main_buf[s] == Event::BOOKEND) {
         *mem_size = offset[18];
         _transposeEventColumns(main_buf,s,mem_size,_debug ? this->_dw_end : this->_cw_end,false);
+        _markShuffled(Event::BOOKEND,s,*mem_size);
         s += *mem_size;
       }
 
@@ -813,6 +1065,7 @@ public:
   }
 
   inline bool _unshuffleColumns(char* main_buf) {
+      StageTimer timer(_stats,_timed(PipelineStage::SHUFFLE_COLUMNS));
       truncateColumnWidthsToVersion();
       // We need to unshuffle event columns before doing anything else
       // Track the starting position of the buffer
@@ -900,51 +1153,48 @@ public:
       *mem_size *= struct_size;
     }
 
-    // Create a new buffer for storing all intermediate data
-    char* buff = new char[*mem_size];
+    // Reuse one scratch buffer for storing all intermediate data
+    if (_tb_size < *mem_size) {
+      if (_tb != nullptr) { delete[] _tb; }
+      _tb      = new char[*mem_size];
+      _tb_size = *mem_size;
+    }
+    char* buff = _tb;
 
     // Use struct size to get the total number of entries in the event array
     unsigned num_entries = (*mem_size) / struct_size;
-    DOUT3("Shuffling " << num_entries << " entries");
+    DOUT3("Shuffling " << num_entries << " entries of event " << hex(ev_code));
 
     // Transpose the columns!
-    unsigned b = 0;
+    transposeColumns(shuffle ? mem_start : buff, shuffle ? buff : mem_start, num_entries, col_widths, unshuffle);
+
+    // If col_widths[i] < 0, then use bitwise column shuffling
     for(unsigned i = 0; col_widths[i] != 0; ++i) {
-      unsigned block_start = mem_off+b;
-      if (col_widths[i] > 0) {  //Normal column shuffling
+      if (col_widths[i] > 0) {
+        continue;
+      }
+      unsigned b = col_offsets[i]*num_entries;  //Start of this column's block
+      for (unsigned e = 0; e < num_entries; ++e) {
+        buff[shuffle ? b+e : e*struct_size+col_offsets[i]] = 0;
+      }
+      for (int bit = 7, ib = 7; ib >= 0; --ib) {
         for (unsigned e = 0; e < num_entries; ++e) {
           unsigned mempos = (e*struct_size+col_offsets[i]);
-          memcpy(
-              &buff[     unshuffle ? mempos : b],
-              &mem_start[unshuffle ? b : mempos],
-              col_widths[i]
-              );
-          b += col_widths[i];
-        }
-      } else {  //If col_widths[i] < 0, then use bitwise column shuffling
-        for (int bit = 7, ib = 7; ib >= 0; --ib) {
-          for (unsigned e = 0; e < num_entries; ++e) {
-            unsigned mempos = (e*struct_size+col_offsets[i]);
-            char r_byte     = mem_start[shuffle ? mempos : b];
-            char r_bit      = (r_byte >> (shuffle ? ib : bit)) & 0x01;
-            char w_bit      = r_bit << (shuffle ? bit : ib);
-            buff[shuffle ? b : mempos] ^= w_bit;
-            if ((--bit) < 0) {
-              bit   = 7;
-              b    += 1;
-            }
+          char r_byte     = mem_start[shuffle ? mempos : b];
+          char r_bit      = (r_byte >> (shuffle ? ib : bit)) & 0x01;
+          char w_bit      = r_bit << (shuffle ? bit : ib);
+          buff[shuffle ? b : mempos] ^= w_bit;
+          if ((--bit) < 0) {
+            bit   = 7;
+            b    += 1;
           }
         }
       }
-      DOUT3("SHUFFLE " << hex(ev_code) << " column " << i << " at " << block_start << " to " << mem_off+b);
     }
 
     // Copy back the shuffled columns
     memcpy(&mem_start[0], &buff[0], *mem_size);
 
-    // Clear the memory buffer
-    delete[] buff;
-
     // All done!
     return true;
   }
@@ -1021,16 +1271,9 @@ public:
   }
 
   static inline const char* readLegacyGeckoCodes() {
-    static bool _legacy_codes_codes_read = false;
-    static char _legacy_gecko_codes[32571];  //exact magic number of decompressed bytes
-    if (! _legacy_codes_codes_read) {
-      _legacy_codes_codes_read = true;
-      // decompress the legacy gecko code data
-      std::string decomp = decompressWithLzma(GECKO_LZMA,GECKO_LZMA_LEN);
-      // Copy buffer from the decompressed string
-      memcpy(_legacy_gecko_codes,decomp.c_str(),decomp.size());
-    }
-    return _legacy_gecko_codes;
+    // decompress the legacy gecko code data on first use (thread-safe static initialization)
+    static const std::string _legacy_gecko_codes = decompressWithLzma(GECKO_LZMA,GECKO_LZMA_LEN);
+    return _legacy_gecko_codes.c_str();
   }
 
   inline void truncateColumnWidthsToVersion() {
@@ -0,0 +1,115 @@
+#ifndef DICT_H_
+#define DICT_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+// Trainer for preset dictionaries shared by many compressed replays.
+//   Each sample (an encoded replay) is cut into chunks wherever a rolling
+//   gear hash of the last 64 bytes has its top bits clear, so the same bytes
+//   produce the same chunks wherever they sit in a file (e.g., gecko code
+//   message blocks and game start events shifted by a few bytes). Chunks
+//   seen in the most samples, weighted by their length, make up the
+//   dictionary, with the most valuable ones last: LZMA codes nearer matches
+//   in fewer bits, and the end of the dictionary is nearest the replay.
+
+const unsigned DICT_MIN_CHUNK    = 64;         //Shortest chunk (unless a sample ends first)
+const unsigned DICT_MAX_CHUNK    = 4096;       //Longest chunk, if no boundary is found sooner
+const unsigned DICT_CUT_BITS     = 9;          //Top hash bits that must be clear for a cut (~512 byte chunks)
+const unsigned DICT_MIN_SAMPLES  = 2;          //Chunks must appear in at least this many samples to be kept
+const size_t   DICT_DEFAULT_SIZE = 1 << 18;    //Default dictionary size
+
+//Random 64-bit value for each byte, mixed into the rolling hash (splitmix64, fixed seed)
+inline const uint64_t* dictGearTable() {
+  static uint64_t table[256];
+  static bool     init = [](){
+    uint64_t x = 0x736c69707063ULL;
+    for (unsigned i = 0; i < 256; ++i) {
+      uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      table[i] = z ^ (z >> 31);
+    }
+    return true;
+  }();
+  (void)init;
+  return table;
+}
+
+//Length of the chunk starting at in, given len bytes remain
+inline size_t dictChunkLength(const uint8_t* in, size_t len) {
+  const uint64_t* gear = dictGearTable();
+  size_t   end = std::min<size_t>(len, DICT_MAX_CHUNK);
+  uint64_t h   = 0;
+  for (size_t i = 0; i < end; ++i) {
+    h = (h << 1) + gear[in[i]];
+    if (i+1 >= DICT_MIN_CHUNK && (h >> (64 - DICT_CUT_BITS)) == 0) {
+      return i+1;
+    }
+  }
+  return end;
+}
+
+//64-bit FNV-1a hash identifying a chunk's contents
+inline uint64_t dictChunkHash(const uint8_t* in, size_t len) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < len; ++i) {
+    h = (h ^ in[i]) * 0x100000001B3ULL;
+  }
+  return h ^ len;
+}
+
+//Build a dictionary of at most max_size bytes from the chunks shared by the
+//  most samples; returns an empty dictionary if no chunk is shared
+inline std::string trainDictionary(const std::vector<std::pair<const char*,size_t>>& samples, size_t max_size = DICT_DEFAULT_SIZE) {
+  struct Chunk {
+    uint32_t    samples = 0;           //Number of samples the chunk appears in
+    uint32_t    last    = UINT32_MAX;  //Last sample the chunk was seen in
+    std::string bytes;                 //Contents (only kept once a second sample has it)
+  };
+  std::unordered_map<uint64_t,Chunk> chunks;
+  for (uint32_t s = 0; s < samples.size(); ++s) {
+    const uint8_t* in  = reinterpret_cast<const uint8_t*>(samples[s].first);
+    size_t         len = samples[s].second;
+    for (size_t off = 0; off < len; ) {
+      size_t n = dictChunkLength(&in[off], len-off);
+      Chunk &c = chunks[dictChunkHash(&in[off], n)];
+      if (c.last != s) {
+        c.last = s;
+        if (++c.samples == DICT_MIN_SAMPLES) {
+          c.bytes.assign(reinterpret_cast<const char*>(&in[off]), n);
+        }
+      }
+      off += n;
+    }
+  }
+
+  // Rank shared chunks by how many bytes they'd save across the samples
+  std::vector<std::pair<uint64_t,const Chunk*>> ranked;
+  for (const auto& kv : chunks) {
+    if (kv.second.samples >= DICT_MIN_SAMPLES) {
+      ranked.push_back({kv.first, &kv.second});
+    }
+  }
+  auto score = [](const Chunk* c) { return uint64_t(c->samples - 1) * c->bytes.size(); };
+  std::sort(ranked.begin(), ranked.end(), [&](const auto& a, const auto& b) {
+    return (score(a.second) != score(b.second)) ? (score(a.second) > score(b.second)) : (a.first < b.first);
+  });
+
+  size_t total = 0, keep = 0;
+  for (; keep < ranked.size() && total + ranked[keep].second->bytes.size() <= max_size; ++keep) {
+    total += ranked[keep].second->bytes.size();
+  }
+  std::string dict;
+  dict.reserve(total);
+  for (size_t i = keep; i > 0; --i) {
+    dict.append(ranked[i-1].second->bytes);
+  }
+  return dict;
+}
+
+#endif /* DICT_H_ */
@@ -0,0 +1,198 @@
+#ifndef LZ_H_
+#define LZ_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// Byte-oriented LZ77 block codec (in the style of LZ4) used as a fast
+//   alternative to LZMA for compressed replays. Event shuffling already
+//   lines up similar bytes, so plain literal / match coding recovers most
+//   of the redundancy, and decoding is little more than a series of memcpys.
+//
+// A block is a series of sequences, each of which is:
+//   token (1 byte)   : high 4 bits = literal count, low 4 bits = match length - LZ_MIN_MATCH
+//   [literal count]  : if the high 4 bits are 15, bytes added to it until one is < 255
+//   literals         : the literal bytes themselves
+//   offset           : LZ_OFFSET_BYTES little-endian bytes, distance back to the match (> 0)
+//   [match length]   : if the low 4 bits are 15, bytes added to it until one is < 255
+// The final sequence has only a token and literals, and ends exactly at the
+//   end of the block.
+
+const unsigned LZ_MIN_MATCH    = 4;                        //Shortest match worth encoding
+const unsigned LZ_OFFSET_BYTES = 3;                        //Bytes used to store each match offset
+const unsigned LZ_WINDOW_BITS  = 8*LZ_OFFSET_BYTES;        //log2 of the farthest a match can be
+const unsigned LZ_HASH_BITS    = 17;                       //log2 of the number of hash chains
+const unsigned LZ_CHAIN_BITS   = 20;                       //log2 of how many positions the chains remember
+const unsigned LZ_TAIL         = 8;                        //Bytes at the end of a block always stored as literals
+const unsigned LZ_DEFAULT_DEPTH = 16;                      //Default number of candidates checked per position
+
+//Largest possible size of a block encoding inlen bytes
+inline size_t lzCompressBound(size_t inlen) {
+  return inlen + (inlen / 255) + 16;
+}
+
+inline uint32_t lzHash(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v,p,4);
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+//Write a 4-bit field's overflow as a run of 255s and a final byte < 255
+inline uint8_t* lzWriteLength(uint8_t* op, size_t n) {
+  for (; n >= 255; n -= 255) {
+    *op++ = 255;
+  }
+  *op++ = uint8_t(n);
+  return op;
+}
+
+inline uint8_t* lzWriteSequence(uint8_t* op, const uint8_t* lit, size_t nlit, size_t off, size_t len) {
+  size_t mlen    = (len > 0) ? (len - LZ_MIN_MATCH) : 0;
+  *op++          = uint8_t(((nlit < 15 ? nlit : 15) << 4) | (mlen < 15 ? mlen : 15));
+  if (nlit >= 15) {
+    op = lzWriteLength(op, nlit - 15);
+  }
+  memcpy(op,lit,nlit);
+  op += nlit;
+  if (len == 0) {
+    return op;
+  }
+  for (unsigned i = 0; i < LZ_OFFSET_BYTES; ++i) {
+    *op++ = uint8_t(off >> (8*i));
+  }
+  if (mlen >= 15) {
+    op = lzWriteLength(op, mlen - 15);
+  }
+  return op;
+}
+
+//Encode inlen bytes from in into out (at least lzCompressBound(inlen) bytes),
+//  checking up to depth earlier positions for each match; returns the encoded size
+inline size_t compressLzBlock(const uint8_t* in, const size_t inlen, uint8_t* out, unsigned depth = LZ_DEFAULT_DEPTH) {
+  const size_t max_off    = (size_t(1) << LZ_WINDOW_BITS) - 1;
+  const size_t chain_mask = (size_t(1) << LZ_CHAIN_BITS) - 1;
+  std::vector<int32_t> head(size_t(1) << LZ_HASH_BITS, -1);  //Latest position with each hash
+  std::vector<int32_t> chain(size_t(1) << LZ_CHAIN_BITS);    //Previous position with the same hash
+
+  uint8_t* op     = out;
+  size_t   anchor = 0;  //First byte not yet written
+  size_t   limit  = (inlen > LZ_TAIL) ? inlen - LZ_TAIL : 0;
+  size_t   ip     = 0;
+  size_t   next   = 0;  //First position not yet added to the hash chains
+  while (ip < limit) {
+    //Add every position up to this one to the hash chains
+    for (; next <= ip; ++next) {
+      uint32_t h            = lzHash(&in[next]);
+      chain[next&chain_mask] = head[h];
+      head[h]               = int32_t(next);
+    }
+
+    //Find the longest earlier match
+    size_t best_len = LZ_MIN_MATCH - 1, best_off = 0;
+    size_t max_len  = inlen - ip;
+    int32_t cand    = chain[ip&chain_mask];
+    for (unsigned d = 0; d < depth && cand >= 0; ++d) {
+      size_t off = ip - size_t(cand);
+      if (off > max_off || off > chain_mask) {
+        break;
+      }
+      const uint8_t* m = &in[cand];
+      if (m[best_len] == in[ip+best_len]) {
+        size_t len = 0;
+        while (len < max_len && m[len] == in[ip+len]) {
+          ++len;
+        }
+        if (len > best_len) {
+          best_len = len;
+          best_off = off;
+          if (len == max_len) {
+            break;
+          }
+        }
+      }
+      cand = chain[size_t(cand)&chain_mask];
+    }
+
+    if (best_off == 0) {
+      ++ip;
+      continue;
+    }
+    op     = lzWriteSequence(op, &in[anchor], ip - anchor, best_off, best_len);
+    ip    += best_len;
+    anchor = ip;
+  }
+  //Everything left over is literals
+  return lzWriteSequence(op, &in[anchor], inlen - anchor, 0, 0) - out;
+}
+
+//Read the overflow of a 4-bit field, failing if it runs past iend
+inline bool lzReadLength(const uint8_t* &ip, const uint8_t* iend, size_t &n) {
+  uint8_t b;
+  do {
+    if (ip >= iend) {
+      return false;
+    }
+    b  = *ip++;
+    n += b;
+  } while (b == 255);
+  return true;
+}
+
+//Decode a block of inlen bytes into exactly outlen bytes of out; returns
+//  false (without ever reading or writing out of bounds) if the block is corrupt
+inline bool decompressLzBlock(const uint8_t* in, const size_t inlen, uint8_t* out, const size_t outlen) {
+  const uint8_t* ip   = in;
+  const uint8_t* iend = in + inlen;
+  uint8_t*       op   = out;
+  uint8_t*       oend = out + outlen;
+  while (ip < iend) {
+    uint8_t token = *ip++;
+    size_t  nlit  = token >> 4;
+    if (nlit == 15 && !lzReadLength(ip, iend, nlit)) {
+      return false;
+    }
+    if (nlit > size_t(iend - ip) || nlit > size_t(oend - op)) {
+      return false;
+    }
+    memcpy(op,ip,nlit);
+    ip += nlit;
+    op += nlit;
+    if (ip == iend) {
+      break;
+    }
+
+    if (size_t(iend - ip) < LZ_OFFSET_BYTES) {
+      return false;
+    }
+    size_t off = 0;
+    for (unsigned i = 0; i < LZ_OFFSET_BYTES; ++i) {
+      off |= size_t(*ip++) << (8*i);
+    }
+    size_t len = token & 15;
+    if (len == 15 && !lzReadLength(ip, iend, len)) {
+      return false;
+    }
+    len += LZ_MIN_MATCH;
+    if (off == 0 || off > size_t(op - out) || len > size_t(oend - op)) {
+      return false;
+    }
+
+    const uint8_t* m = op - off;
+    if (off >= len) {         //No overlap
+      memcpy(op,m,len);
+    } else if (off == 1) {    //Run of one byte
+      memset(op,*m,len);
+    } else {                  //Overlapping copy repeats the last off bytes
+      for (size_t left = len; left > 0; ) {
+        size_t n = (left < off) ? left : off;
+        memcpy(op + (len - left),m + (len - left),n);
+        left -= n;
+      }
+    }
+    op += len;
+  }
+  return op == oend;
+}
+
+#endif /* LZ_H_ */
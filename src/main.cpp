@@ -1,11 +1,17 @@
 #include <algorithm>
 #include <sys/stat.h>
 #include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <map>
 
 #include "util.h"
 #include "parser.h"
 #include "analyzer.h"
 #include "compressor.h"
+#include "manifest.h"
 
 // #define GUI_ENABLED 1  //debug, normally enable this from the makefile
 
@@ -14,8 +20,10 @@
 #endif
 
 typedef std::filesystem::directory_iterator            f_iter;
+typedef std::filesystem::recursive_directory_iterator  rf_iter;
 typedef std::filesystem::directory_entry               f_entry;
 typedef std::vector<std::__cxx11::basic_string<char> > str_vec;
+typedef std::vector<std::string>                       err_vec;
 
 namespace slip {
 
@@ -35,6 +43,17 @@ bool cmdOptionExists(char** begin, char** end, const std::string& option) {
   return std::find(begin, end, option) != end;
 }
 
+// Get the value of an option passed as --option=value
+char* getCmdLongOption(char ** begin, char ** end, const std::string & option) {
+  std::string prefix = option+"=";
+  for (char ** itr = begin; itr != end; ++itr) {
+    if (strncmp(*itr,prefix.c_str(),prefix.size()) == 0) {
+      return *itr+prefix.size();
+    }
+  }
+  return 0;
+}
+
 #if GUI_ENABLED == 1
   bool askYesNo(std::string title, std::string question) {
     return pfd::message(title, question, pfd::choice::yes_no, pfd::icon::question).result()==pfd::button::yes;
@@ -43,13 +62,52 @@ bool cmdOptionExists(char** begin, char** end, const std::string& option) {
 
 void printUsage() {
   std::cout
-    << "Usage: slippc -i <infile> [-x | -X <zlpfle>] [-j <jsonfile>] [-a <analysisfile>] [-f] [-d <debuglevel>] [-h]:" << std::endl
+    << "Usage: slippc -i <infile> [-x | -X <zlpfle>] [--validate=<mode>] [-j <jsonfile>] [-a <analysisfile>] [-f] [-t <threads>] [-r] [--glob=<pattern>] [--incremental] [--codec=<codec>] [--lzma-preset=<preset>] [--lzma-threads=<threads>] [--block-frames=<frames>] [--stats=<statsfile>] [--dict=<dictfile>] [--train-dict=<dictfile>] [--dict-size=<bytes>] [--columnar=<colfile>] [--corpus=<corpusfile>] [--fields=<fields>] [-d <debuglevel>] [-h]:" << std::endl
     << "  -i        Set input file (can be .slp, .zlp, or a whole directory)" << std::endl
     << "  -j        Output <infile> in .json format to <jsonfile> (use \"-\" for stdout)" << std::endl
     << "  -a        Output an analysis of <infile> in .json format to <analysisfile> (use \"-\" for stdout)" << std::endl
     << "  -f        When used with -j <jsonfile>, write full frame info (instead of just frame deltas)" << std::endl
     << "  -x        Compress or decompress a replay" << std::endl
     << "  -X        Set output file name for compression" << std::endl
+    << "  -t        Process files in directory mode with <threads> threads (0 = one per core; default: 1)" << std::endl
+    << "  -r        Process files in subdirectories in directory mode, mirroring them in the output directories" << std::endl
+    << "  --glob=<pattern>" << std::endl
+    << "            Only process files whose names match <pattern> in directory mode (e.g., \"Game_2022*\")" << std::endl
+    << "  --incremental" << std::endl
+    << "            Skip files in directory mode whose outputs are already up to date" << std::endl
+    << "  --validate=<mode>" << std::endl
+    << "            Validate compression / decompression by decoding in memory (default: full)" << std::endl
+    << "              full: decode with an independent decoder (safest)" << std::endl
+    << "              fast: decode in place, reusing the encoder's buffers" << std::endl
+    << "              none: skip validation" << std::endl
+    << "  --codec=<codec>" << std::endl
+    << "            Compress replays with <codec> (default: lzma); any codec's output decompresses with -x" << std::endl
+    << "              lzma: smallest output" << std::endl
+    << "              lz:   larger output, but many times faster to compress and decompress" << std::endl
+    << "              none: store the encoded replay without compressing it" << std::endl
+    << "  --lzma-preset=<preset>" << std::endl
+    << "            Compress with LZMA preset 0-9, optionally followed by \"e\" for extreme (default: 6)" << std::endl
+    << "  --lzma-threads=<threads>" << std::endl
+    << "            Compress each replay with <threads> threads (0 = one per core; default: 1)" << std::endl
+    << "  --block-frames=<frames>" << std::endl
+    << "            Compress replays into independently decodable blocks of <frames> frames, with an index for random access" << std::endl
+    << "  --stats=<statsfile>" << std::endl
+    << "            With -x, write per-stage timings, per-event byte counts (except with --block-frames), and prediction hit rates in .json format to <statsfile> (use \"-\" for stdout)" << std::endl
+    << "  --dict=<dictfile>" << std::endl
+    << "            Compress replays with LZMA primed with the dictionary in <dictfile>, which is then needed to decompress them" << std::endl
+    << "  --train-dict=<dictfile>" << std::endl
+    << "            Train a dictionary for --dict from the replays in the input directory (honoring -r and --glob) and save it to <dictfile>" << std::endl
+    << "  --dict-size=<bytes>" << std::endl
+    << "            Maximum size of a dictionary trained with --train-dict (default: " << DICT_DEFAULT_SIZE << ")" << std::endl
+    << "  --columnar=<colfile>" << std::endl
+    << "            Output <infile>'s game, player, frame, and item data in binary columnar (.slpc) format to <colfile> (use \"-\" for stdout)" << std::endl
+    << "  --corpus=<corpusfile>" << std::endl
+    << "            Append every input replay to the single file <corpusfile>, tagged with a game_id:" << std::endl
+    << "              .slpc:   game, player, frame, and item tables in binary columnar format" << std::endl
+    << "              .ndjson: one line with the analysis of each replay" << std::endl
+    << "  --fields=<fields>" << std::endl
+    << "            With -j, --columnar, or --corpus, only parse and output the comma-separated list of frame / item" << std::endl
+    << "            fields <fields> (e.g., action_post,pos_x_post,pos_y_post); items are skipped if no item fields are listed" << std::endl
     << std::endl
     << "Debug options:" << std::endl
     << "  -d           Run at debug level <debuglevel> (show debug output)" << std::endl
@@ -62,33 +120,96 @@ void printUsage() {
 
 typedef struct _cmdoptions {
   char* dlevel       = nullptr;
+  char* tcount       = nullptr;
   char* infile       = nullptr;
   char* cfile        = nullptr;
   char* outfile      = nullptr;
   char* analysisfile = nullptr;
+  char* colfile      = nullptr;
+  char* corpusfile   = nullptr;
+  char* fields       = nullptr;
+  char* glob         = nullptr;
+  char* statsfile    = nullptr;
+  char* dictfile     = nullptr;
+  char* traindict    = nullptr;
   bool  nodelta      = false;
   bool  encode       = false;
   bool  rawencode    = false;
   bool  skipsave     = false;
   bool  dumpgecko    = false;
   bool  dirmode      = false;
+  bool  recursive    = false;
+  bool  incremental  = false;
+  int   validate     = Validate::FULL;
   int   debug        = 0;
+  unsigned threads   = 1;
+  int      codec       = Codec::LZMA;
+  uint32_t lzmapreset  = 6;
+  unsigned lzmathreads = 1;
+  unsigned blockframes = 0;
+  uint64_t dictid      = 0;
+  size_t   dictsize    = DICT_DEFAULT_SIZE;
+  uint32_t gameid      = 0;
+  const FieldSelection* fieldsel = nullptr;  //Parsed from fields (shared by all copies of the options)
 } cmdoptions;
 
+//Most replays sampled from a directory when training a dictionary
+const unsigned DICT_MAX_TRAIN_FILES = 256;
+
+//Most files processed in directory mode that may be waiting to be reported
+//  (and held in memory) at once, per thread
+const unsigned DIR_MAX_PENDING_PER_THREAD = 4;
+
+//Kinds of output files written in directory mode
+namespace DirOutput {
+  enum { JSON = 0, ANALYSIS = 1, COMPRESSED = 2, COLUMNAR = 3, COUNT = 4 };
+}
+
+//Output of processing a single file in directory mode, held until it can be reported in order
+typedef struct _fileresult {
+  std::string   log;                           //Everything logged while processing the file
+  err_vec       errors;                        //Messages to write to the error log
+  int           ret     = 0;                   //Return value from handleSingleFile()
+  bool          updated[DirOutput::COUNT] = {false}; //Whether each manifest needs updating
+  manifestentry entry[DirOutput::COUNT];       //New manifest entries for this file
+  std::string   corpus;                        //Rows to append to the --corpus output
+} fileresult;
+
 cmdoptions getCommandLineOptions(int argc, char** argv) {
   _cmdoptions c;
   c.dlevel       = getCmdOption(   argv, argv+argc, "-d");
+  c.tcount       = getCmdOption(   argv, argv+argc, "-t");
   c.infile       = getCmdOption(   argv, argv+argc, "-i");
   c.cfile        = getCmdOption(   argv, argv+argc, "-X");
   c.outfile      = getCmdOption(   argv, argv+argc, "-j");
   c.analysisfile = getCmdOption(   argv, argv+argc, "-a");
+  c.colfile      = getCmdLongOption(argv, argv+argc, "--columnar");
+  c.corpusfile   = getCmdLongOption(argv, argv+argc, "--corpus");
+  c.fields       = getCmdLongOption(argv, argv+argc, "--fields");
   c.nodelta      = cmdOptionExists(argv, argv+argc, "-f");
   c.encode       = cmdOptionExists(argv, argv+argc, "-x");
   c.rawencode    = cmdOptionExists(argv, argv+argc, "--raw-enc");
   c.skipsave     = cmdOptionExists(argv, argv+argc, "--skip-save");
   c.dumpgecko    = cmdOptionExists(argv, argv+argc, "--dump-gecko");
+  c.recursive    = cmdOptionExists(argv, argv+argc, "-r");
+  c.incremental  = cmdOptionExists(argv, argv+argc, "--incremental");
+  c.glob         = getCmdLongOption(argv, argv+argc, "--glob");
+  c.statsfile    = getCmdLongOption(argv, argv+argc, "--stats");
+  c.dictfile     = getCmdLongOption(argv, argv+argc, "--dict");
+  c.traindict    = getCmdLongOption(argv, argv+argc, "--train-dict");
   c.dirmode      = isDirectory(c.infile);
 
+  char* vmode    = getCmdLongOption(argv, argv+argc, "--validate");
+  if (vmode) {
+    if (strcmp(vmode,"none") == 0) {
+      c.validate = Validate::NONE;
+    } else if (strcmp(vmode,"fast") == 0) {
+      c.validate = Validate::FAST;
+    } else if (strcmp(vmode,"full") != 0) {
+      std::cerr << "Warning: invalid validation mode, using full validation" << std::endl;
+    }
+  }
+
   if (c.dlevel) {
     if (c.dlevel[0] >= '0' && c.dlevel[0] <= '9') {
       c.debug = c.dlevel[0]-'0';
@@ -100,6 +221,83 @@ cmdoptions getCommandLineOptions(int argc, char** argv) {
     }
   }
 
+  if (c.tcount) {
+    int t = atoi(c.tcount);
+    if (t < 0 || (t == 0 && c.tcount[0] != '0')) {
+      std::cerr << "Warning: invalid thread count, using 1 thread" << std::endl;
+    } else if (t == 0) {
+      c.threads = std::max(1u,std::thread::hardware_concurrency());
+    } else {
+      c.threads = t;
+    }
+  }
+
+  char* cname    = getCmdLongOption(argv, argv+argc, "--codec");
+  if (cname) {
+    if (strcmp(cname,"lz") == 0) {
+      c.codec = Codec::LZ;
+    } else if (strcmp(cname,"none") == 0) {
+      c.codec = Codec::NONE;
+    } else if (strcmp(cname,"lzma") != 0) {
+      std::cerr << "Warning: invalid codec, using lzma" << std::endl;
+    }
+  }
+
+  char* lpreset  = getCmdLongOption(argv, argv+argc, "--lzma-preset");
+  if (lpreset) {
+    if (lpreset[0] >= '0' && lpreset[0] <= '9' && (lpreset[1] == '\0' || (lpreset[1] == 'e' && lpreset[2] == '\0'))) {
+      c.lzmapreset = (lpreset[0]-'0') | (lpreset[1] == 'e' ? LZMA_PRESET_EXTREME : 0);
+    } else {
+      std::cerr << "Warning: invalid LZMA preset, using preset 6" << std::endl;
+    }
+  }
+
+  char* lthreads = getCmdLongOption(argv, argv+argc, "--lzma-threads");
+  if (lthreads) {
+    int t = atoi(lthreads);
+    if (t < 0 || (t == 0 && lthreads[0] != '0')) {
+      std::cerr << "Warning: invalid LZMA thread count, using 1 thread" << std::endl;
+    } else if (t == 0) {
+      c.lzmathreads = std::max(1u,std::thread::hardware_concurrency());
+    } else {
+      c.lzmathreads = t;
+    }
+  }
+
+  char* bframes  = getCmdLongOption(argv, argv+argc, "--block-frames");
+  if (bframes) {
+    int f = atoi(bframes);
+    if (f <= 0) {
+      std::cerr << "Warning: invalid block size, compressing as a single stream" << std::endl;
+    } else {
+      c.blockframes = f;
+    }
+  }
+
+  char* dsize    = getCmdLongOption(argv, argv+argc, "--dict-size");
+  if (dsize) {
+    long n = atol(dsize);
+    if (n <= 0) {
+      std::cerr << "Warning: invalid dictionary size, using " << DICT_DEFAULT_SIZE << " bytes" << std::endl;
+    } else {
+      c.dictsize = n;
+    }
+  }
+
+  if (c.dictfile) {
+    uint32_t size;
+    char*    buf = readFile(c.dictfile,size);
+    if (buf == nullptr) {
+      std::cerr << "Warning: could not read dictionary " << c.dictfile << ", compressing without it" << std::endl;
+    } else {
+      c.dictid = registerDictionary(buf,size)->id;
+      if (c.codec == Codec::LZMA) {
+        c.codec = Codec::DICT;
+      }
+      delete[] buf;
+    }
+  }
+
   if (c.debug) {
     DOUT1("Running at debug level " << +c.debug);
   }
@@ -163,10 +361,25 @@ inline void cleanupCommandOptions(cmdoptions &c) {
   if(c.analysisfile) {
     delete[] c.analysisfile;
   }
+  if(c.colfile) {
+    delete[] c.colfile;
+  }
 }
 
-int handleCompression(const cmdoptions &c, const int debug) {
-  slip::Compressor cmp(debug);
+int handleStats(const cmdoptions &c, const int debug, const slip::Compressor &cmp) {
+  if (c.statsfile[0] == '-' && c.statsfile[1] == '\0') {
+    DOUT1("  Writing compression stats to stdout");
+    std::cout << cmp.stats().asJson() << std::endl;
+  } else {
+    DOUT1("  Saving compression stats to file");
+    std::ofstream fout(c.statsfile);
+    fout << cmp.stats().asJson() << std::endl;
+  }
+  return 0;
+}
+
+int handleCompression(const cmdoptions &c, const int debug, slip::Compressor &cmp, char* buf, uint32_t size) {
+  cmp.reset();
 
   if (c.cfile) {
     if (!(cmp.setOutputFilename(c.cfile))) {
@@ -179,15 +392,20 @@ int handleCompression(const cmdoptions &c, const int debug) {
     DOUT1("  Setting gecko output filename");
     cmp.setGeckoOutputFilename(c.infile);
   }
+  cmp.setCodec(c.codec);
+  cmp.setDictionary(findDictionary(c.dictid));
+  cmp.setLzmaOptions(c.lzmapreset,c.lzmathreads);
+  cmp.setBlockFrames(c.blockframes);
+  cmp.setStatsDetail(c.statsfile != nullptr);
 
   DOUT1("  Encoding / decoding replay");
-  if (not cmp.loadFromFile(c.infile)) {
+  if (not cmp.loadFromSharedBuff(buf,size,c.infile)) {
     FAIL("  Failed to encode input; exiting");
     return 2;
   }
 
   DOUT1("  Validating encoding");
-  if (!cmp.validate()) {
+  if (!cmp.validate(c.validate)) {
     FAIL("  Validation failed; exiting");
     return 3;
   }
@@ -199,6 +417,10 @@ int handleCompression(const cmdoptions &c, const int debug) {
     cmp.saveToFile(c.rawencode);
   }
 
+  if (c.statsfile) {
+    handleStats(c,debug,cmp);
+  }
+
   return 0;
 }
 
@@ -211,12 +433,20 @@ int handleAnalysis(const cmdoptions &c, const int debug, slip::Parser &p) {
       if (debug) {
         DOUT1("  Writing analysis to stdout");
       }
-      std::cout << a->asJson() << std::endl;
+      std::cout.flush();
+      OutputSink out(stdout);
+      a->writeJson(out);
+      out << "\n";
+      out.close();
     } else {
       if (debug) {
         DOUT1("  Saving analysis to file");
       }
-      a->save(c.analysisfile);
+      if (!a->save(c.analysisfile)) {
+        FAIL("Failed to write analysis to " << c.analysisfile);
+        delete a;
+        return 1;
+      }
     }
   }
 
@@ -230,26 +460,152 @@ int handleJson(const cmdoptions &c, const int debug, slip::Parser &p) {
     if (debug) {
       DOUT1("  Writing Slippi JSON data to stdout");
     }
-    std::cout << p.asJson(!c.nodelta) << std::endl;
+    std::cout.flush();
+    OutputSink out(stdout);
+    p.writeJson(out,!c.nodelta);
+    out << "\n";
+    out.close();
   } else {
     if (debug) {
       DOUT1("  Saving Slippi JSON data to file");
     }
-    p.save(c.outfile,!c.nodelta);
+    if (!p.save(c.outfile,!c.nodelta)) {
+      return 1;
+    }
   }
   return 0;
 }
 
-int handleSingleFile(const cmdoptions &c, const int debug) {
+int handleColumnar(const cmdoptions &c, const int debug, slip::Parser &p) {
+  DOUT1(" Writing columnar data");
+  if (c.colfile[0] == '-' && c.colfile[1] == '\0') {
+    if (debug) {
+      DOUT1("  Writing columnar data to stdout");
+    }
+    std::cout.flush();
+    OutputSink out(stdout);
+    p.writeColumns(out);
+    out.close();
+  } else {
+    if (debug) {
+      DOUT1("  Saving columnar data to file");
+    }
+    if (!p.saveColumns(c.colfile)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//Whether the --corpus output holds analysis lines (.ndjson) rather than columnar tables (.slpc)
+inline bool isNdjsonCorpus(const cmdoptions &c) {
+  return getFileExt(c.corpusfile) == "ndjson";
+}
+
+//Add this replay's rows for the --corpus output to out: its columnar
+//  tables, or a line with its analysis
+int handleCorpus(const cmdoptions &c, const int debug, slip::Parser &p, std::string &out) {
+  DOUT1(" Writing corpus rows for game " << c.gameid);
+  OutputSink sink([&out](const char* data, size_t len) { out.append(data,len); });
+  if (!isNdjsonCorpus(c)) {
+    slip::ColumnarWriter w(sink);
+    slip::writeReplayColumns(*p.replay(),w,c.gameid,c.fieldsel);
+    return 0;
+  }
+  slip::Analysis *a = p.analyze();
+  if (a->success) {
+    std::string json = a->asJson();
+    json.erase(std::remove(json.begin(),json.end(),'\n'),json.end());
+    sink << "{\"game_id\" : " << c.gameid << ", \"analysis\" : " << json << "}\n";
+  }
+  delete a;
+  return 0;
+}
+
+//Find where the last complete line of an existing .ndjson corpus ends and
+//  the highest game_id in it (-1 if none); returns false if any line isn't
+//  one of ours
+bool scanNdjsonCorpus(const char* fname, uint64_t &valid_end, int64_t &max_game_id) {
+  const std::string prefix = "{\"game_id\" : ";
+  valid_end   = 0;
+  max_game_id = -1;
+  std::ifstream f(fname, std::ios::binary);
+  std::string line;
+  while (std::getline(f,line)) {
+    if (f.eof()) {
+      break;  //No newline, so the line is incomplete
+    }
+    if (line.compare(0,prefix.size(),prefix) != 0) {
+      return false;
+    }
+    max_game_id = std::max<int64_t>(max_game_id,strtoll(line.c_str()+prefix.size(),nullptr,10));
+    valid_end  += line.size()+1;
+  }
+  return true;
+}
+
+//Open the --corpus output for appending, dropping any incomplete data left
+//  by an interrupted run; the first game ID to use is stored in next_id
+OutputSink* openCorpus(const cmdoptions &c, uint32_t &next_id) {
+  bool ndjson = isNdjsonCorpus(c);
+  if (!ndjson && getFileExt(c.corpusfile) != "slpc") {
+    FAIL("Corpus file " << c.corpusfile << " must end in .slpc or .ndjson");
+    return nullptr;
+  }
+  uint64_t valid_end = 0;
+  int64_t  max_id    = -1;
+  if (fileExists(c.corpusfile)) {
+    bool valid = ndjson ? scanNdjsonCorpus(c.corpusfile,valid_end,max_id) : slip::scanColumnarFile(c.corpusfile,valid_end,max_id);
+    if (!valid) {
+      FAIL("File " << c.corpusfile << " exists but is not a corpus file; refusing to append to it");
+      return nullptr;
+    }
+    std::error_code ec;
+    if (std::filesystem::file_size(c.corpusfile,ec) > valid_end) {
+      WARN("Discarding incomplete data at the end of " << c.corpusfile);
+      std::filesystem::resize_file(c.corpusfile,valid_end,ec);
+    }
+  }
+  OutputSink* out = new OutputSink(c.corpusfile,true);
+  if (!out->ok()) {
+    FAIL("Could not open corpus file " << c.corpusfile);
+    delete out;
+    return nullptr;
+  }
+  if ((!ndjson) && out->position() == 0) {
+    slip::ColumnarWriter(*out).fileHeader();
+  }
+  next_id = max_id+1;
+  return out;
+}
+
+//Process one replay, reusing the given parser and compressor (they're reset first)
+int handleSingleFile(const cmdoptions &c, const int debug, slip::Parser &p, slip::Compressor &cmp,
+  err_vec* errors = nullptr, std::string* corpus = nullptr, std::string* md5 = nullptr) {
   int retc = 0;  //return value from compression phase
   int reta = 0;  //return value from analysis phase
   int retj = 0;  //return value from jsonoutput phase
+  int retk = 0;  //return value from columnar output phase
+  int reto = 0;  //return value from corpus output phase
+
+  // Read (and if necessary decompress) the input once; the parser and the
+  //   compressor both work directly off of this one buffer
+  uint32_t size;
+  bool     mapped;
+  char*    buf = loadReplayFile(c.infile,size,mapped,md5);
+  if (buf == nullptr) {
+    FAIL("  File " << c.infile << " could not be opened or does not exist");
+    return 2;
+  }
 
-  if (c.outfile || c.analysisfile) {
+  // Parse first, since decoding a .zlp input rewrites the shared buffer
+  if (c.outfile || c.analysisfile || c.colfile || corpus) {
     DOUT1(" Parsing");
-    slip::Parser p(debug);
-    if (not p.load(c.infile)) {
+    p.reset();
+    p.setFields(c.fieldsel);
+    if (not p.loadFromSharedBuff(buf,size,c.infile)) {
       FAIL("    Could not load input; exiting");
+      unmapFile(buf,size,mapped);
       return 2;
     }
 
@@ -257,6 +613,14 @@ int handleSingleFile(const cmdoptions &c, const int debug) {
       retj = handleJson(c,debug,p);
     }
 
+    if (c.colfile) {
+      retk = handleColumnar(c,debug,p);
+    }
+
+    if (corpus) {
+      reto = handleCorpus(c,debug,p,*corpus);
+    }
+
     if (c.analysisfile) {
       reta = handleAnalysis(c,debug,p);
     }
@@ -264,23 +628,309 @@ int handleSingleFile(const cmdoptions &c, const int debug) {
 
   if (c.cfile || c.encode || c.skipsave) {
     DOUT1(" Compressing ");
-    retc = handleCompression(c,debug);
-    if ((!c.skipsave) && c.dirmode && c.cfile && (!fileExists(c.cfile))) {
+    retc = handleCompression(c,debug,cmp,buf,size);
+    if ((!c.skipsave) && errors && c.cfile && (!fileExists(c.cfile))) {
       FAIL("  Failed to compress file, logging error");
-      ERRLOG(PATH(c.cfile).parent_path(),c.infile << " could not be compressed");
+      errors->push_back(std::string(c.infile)+" could not be "+(getFileExt(c.cfile) == "slp" ? "decompressed" : "compressed"));
     }
   }
 
   if (debug) {
     DOUT1(" Cleaning up");
   }
-  return retc+reta+retj;
+  p.reset();    //Don't hold on to this replay's frames or (now stale) shared buffer
+  cmp.reset();
+  unmapFile(buf,size,mapped);
+  return retc+reta+retj+retk+reto;
+}
+
+//Output directory for each kind of output in directory mode (nullptr if not requested)
+char* directoryOutput(const cmdoptions &c, unsigned kind) {
+  switch(kind) {
+    case DirOutput::JSON:       return c.outfile;
+    case DirOutput::ANALYSIS:   return c.analysisfile;
+    case DirOutput::COMPRESSED: return c.cfile;
+    case DirOutput::COLUMNAR:   return c.colfile;
+  }
+  return nullptr;
+}
+
+//Version of the code producing each kind of output; outputs written by any
+//  other version are considered out of date
+std::string directoryOutputVersion(const cmdoptions &c, unsigned kind) {
+  std::string fields = c.fields ? std::string("-fields-")+c.fields : "";
+  // compressed output also depends on how it was compressed, and whether it needs a dictionary to read
+  std::string codec  = "-codec-"+std::to_string(c.codec)
+    +(c.codec == Codec::DICT ? "-dict-"+dictionaryIdString(c.dictid) : "")
+    +(c.blockframes ? "-blocks-"+std::to_string(c.blockframes) : "");
+  switch(kind) {
+    case DirOutput::JSON:       return "parser-"+PARSER_VERSION+(c.nodelta ? "-full" : "-delta")+fields;
+    case DirOutput::ANALYSIS:   return "parser-"+PARSER_VERSION+"-analyzer-"+ANALYZER_VERSION;
+    case DirOutput::COMPRESSED: return "compressor-"+COMPRESSOR_VERSION+codec;
+    case DirOutput::COLUMNAR:   return "parser-"+PARSER_VERSION+"-columnar-"+std::to_string(COLUMNAR_VERSION)+fields;
+  }
+  return "";
+}
+
+void handleDirectoryFile(const cmdoptions &c, const int debug, const std::string &rel, unsigned index,
+  const manifest* manifests, fileresult &r, slip::Parser &parser, slip::Compressor &cmp) {
+  PATH p(rel);
+  PATH subdir       = p.parent_path();
+  std::string base  = p.filename().string();
+  std::string noext = p.stem().string();
+  bool compressed   = (getFileExt(base) == "zlp");
+  cmdoptions c2;
+  copyCommandOptions(c,c2);
+  c2.gameid = c.gameid + index;  //Corpus game IDs follow the (sorted) file order
+  stringtoChars((PATH(c.infile) / p).string(),&(c2.infile));
+  if(c2.cfile) {
+    stringtoChars((PATH(c.cfile) / subdir / PATH(noext+(compressed ? ".slp" : ".zlp"))).string(),&(c2.cfile));
+  }
+  if(c2.outfile) {
+    stringtoChars((PATH(c.outfile) / subdir / PATH(base+".json")).string(),&(c2.outfile));
+  }
+  if(c2.analysisfile) {
+    stringtoChars((PATH(c.analysisfile) / subdir / PATH(noext+"-analysis.json")).string(),&(c2.analysisfile));
+  }
+  if(c2.colfile) {
+    stringtoChars((PATH(c.colfile) / subdir / PATH(noext+".slpc")).string(),&(c2.colfile));
+  }
+
+  if (c.incremental) {
+    // skip any outputs already produced from identical input by the current version
+    manifestentry cur = statManifestInput(c2.infile);
+    char** outs[DirOutput::COUNT] = {&c2.outfile, &c2.analysisfile, &c2.cfile, &c2.colfile};
+    unsigned pending = 0;
+    for (unsigned k = 0; k < DirOutput::COUNT; ++k) {
+      if (*outs[k] == nullptr) {
+        continue;
+      }
+      auto it = manifests[k].find(rel);
+      if (it != manifests[k].end()) {
+        const manifestentry &e = it->second;
+        if (manifestEntryCurrent(e,cur,directoryOutputVersion(c,k),c2.infile,*outs[k])) {
+          if (e.mtime != cur.mtime) {
+            r.updated[k]     = true;  //remember the new stats so next time is just a stat
+            r.entry[k]       = e;
+            r.entry[k].mtime = cur.mtime;
+          }
+          DOUT1("  Output " << *outs[k] << " is up to date");
+          delete[] *outs[k];
+          *outs[k] = nullptr;
+          continue;
+        }
+      }
+      ++pending;
+    }
+    if (pending == 0) {
+      INFO("Skipping unchanged file " << CYN << c2.infile << BLN);
+      cleanupCommandOptions(c2);
+      return;
+    }
+
+    INFO("Processing file " << CYN << c2.infile << BLN);
+    // hash the input as it's read for processing, unless we already had to
+    r.ret = handleSingleFile(c2,debug,parser,cmp,&r.errors,c.corpusfile ? &r.corpus : nullptr,
+      cur.md5.empty() ? &cur.md5 : nullptr);
+    for (unsigned k = 0; k < DirOutput::COUNT; ++k) {
+      if (*outs[k] == nullptr) {
+        continue;
+      }
+      // record outputs that were written, or that legitimately had nothing to write
+      bool written = fileExists(*outs[k]);
+      if (written || r.ret == 0) {
+        r.updated[k]       = true;
+        r.entry[k]         = cur;
+        r.entry[k].output  = written;
+        r.entry[k].version = directoryOutputVersion(c,k);
+      }
+    }
+  } else {
+    INFO("Processing file " << CYN << c2.infile << BLN);
+    r.ret = handleSingleFile(c2,debug,parser,cmp,&r.errors,c.corpusfile ? &r.corpus : nullptr);
+  }
+  if (r.ret != 0) {
+    WARN("  Encountered errors processing input file " << RED << c2.infile << BLN);
+  }
+  cleanupCommandOptions(c2);
+}
+
+//Whether a directory entry is a replay we should process in directory mode
+bool isDirectoryReplay(const cmdoptions &c, const f_entry &entry) {
+  if (!entry.is_regular_file()) {
+    return false;
+  }
+  std::string name = entry.path().filename().string();
+  std::string ext  = getFileExt(name);
+  if (ext != "slp" && ext != "zlp") {
+    return false;
+  }
+  return (c.glob == nullptr) || matchGlob(c.glob,name.c_str());
+}
+
+//Find all replays in (or with -r, under) the input directory, relative to it
+str_vec findDirectoryReplays(const cmdoptions &c) {
+  PATH    root(c.infile);
+  str_vec files;
+  if (!c.recursive) {
+    for (const f_entry & entry : f_iter(root)) {
+      if (isDirectoryReplay(c,entry)) {
+        files.push_back(entry.path().lexically_relative(root).string());
+      }
+    }
+    return files;
+  }
+
+  // don't descend into our own output directories if they're under the input
+  std::vector<PATH> outdirs;
+  for (const char* o : {c.cfile, c.outfile, c.analysisfile, c.colfile}) {
+    if (o) {
+      outdirs.push_back(std::filesystem::weakly_canonical(o));
+    }
+  }
+  std::error_code ec;
+  rf_iter it(root, std::filesystem::directory_options::skip_permission_denied, ec);
+  for (; !ec && it != rf_iter(); it.increment(ec)) {
+    if (it->is_directory()) {
+      PATH d = std::filesystem::weakly_canonical(it->path());
+      if (std::find(outdirs.begin(),outdirs.end(),d) != outdirs.end()) {
+        it.disable_recursion_pending();
+      }
+    } else if (isDirectoryReplay(c,*it)) {
+      files.push_back(it->path().lexically_relative(root).string());
+    }
+  }
+  if (ec) {
+    WARN("Error scanning " << c.infile << ": " << ec.message());
+  }
+  return files;
+}
+
+//Analysis and columnar outputs are named after each replay's name without its
+//  extension, so replays like game.slp and game.zlp in the same directory
+//  would write the same files (at the same time with -t); skip all of them
+void removeStemCollisions(const cmdoptions &c, str_vec &files) {
+  if (!(c.analysisfile || c.colfile)) {
+    return;
+  }
+  std::map<std::string,unsigned> stems;
+  for (const std::string& f : files) {
+    ++stems[(PATH(f).parent_path() / PATH(f).stem()).string()];
+  }
+  str_vec kept;
+  for (const std::string& f : files) {
+    if (stems[(PATH(f).parent_path() / PATH(f).stem()).string()] > 1) {
+      WARN("Skipping " << f << ": another replay with the same name would write the same output files");
+    } else {
+      kept.push_back(f);
+    }
+  }
+  files.swap(kept);
+}
+
+//Mirror the input directory structure of every replay into the output directories
+void makeOutputSubdirectories(const cmdoptions &c, const str_vec &files) {
+  str_vec subdirs;
+  for (const std::string& f : files) {
+    std::string d = PATH(f).parent_path().string();
+    if (!d.empty() && (subdirs.empty() || subdirs.back() != d)) {
+      subdirs.push_back(d);
+    }
+  }
+  for (const std::string& d : subdirs) {
+    for (const char* o : {c.cfile, c.outfile, c.analysisfile, c.colfile}) {
+      if (o && (!makeDirectoryIfNotExists((PATH(o) / PATH(d)).string().c_str()))) {
+        WARN("Could not create output directory " << (PATH(o) / PATH(d)));
+      }
+    }
+  }
 }
 
-int handleDirectory(const cmdoptions &c, const int debug) {
+//Read ahead the i-th file in directory mode, if there is one
+void prefetchDirectoryFile(const cmdoptions &c, const str_vec &files, unsigned i) {
+  if (i < files.size()) {
+    prefetchFile((PATH(c.infile) / PATH(files[i])).string().c_str());
+  }
+}
+
+void reportDirectoryFile(const cmdoptions &c, const std::string &rel, const fileresult &r,
+  manifest* updates, std::ofstream* journals, OutputSink* corpus) {
+  for (const std::string& e : r.errors) {
+    ERRLOG(PATH(c.cfile),e);
+  }
+  if (corpus) {
+    corpus->write(r.corpus.data(),r.corpus.size());
+  }
+  for (unsigned k = 0; k < DirOutput::COUNT; ++k) {
+    if (r.updated[k]) {
+      updates[k][rel] = r.entry[k];
+      if (journals[k].is_open()) {
+        appendManifestEntry(journals[k],rel,r.entry[k]);
+      }
+    }
+  }
+}
+
+void handleDirectoryParallel(const cmdoptions &c, const int debug, const str_vec &files,
+  unsigned nthreads, const manifest* manifests, manifest* updates, std::ofstream* journals, OutputSink* corpus) {
+  // hand out files to worker threads one at a time as they become free
+  DOUT1("Processing " << files.size() << " files with " << nthreads << " threads");
+  std::atomic<unsigned>   next(0);
+  std::mutex              mtx;
+  std::condition_variable cv;
+  std::map<unsigned,fileresult> finished;  //results not yet reported, by file index
+  unsigned                reported = 0;    //number of files reported so far
+  const unsigned          window   = nthreads*DIR_MAX_PENDING_PER_THREAD;
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < nthreads; ++t) {
+    workers.emplace_back([&]() {
+      // one parser and compressor per worker, reused for every file it processes
+      slip::Parser     parser(debug);
+      slip::Compressor cmp(debug);
+      for (unsigned i = next++; i < files.size(); i = next++) {
+        {
+          // don't get too far ahead of the file being reported, so results waiting on it don't pile up
+          std::unique_lock<std::mutex> lock(mtx);
+          cv.wait(lock, [&]{ return i < reported + window; });
+        }
+        prefetchDirectoryFile(c,files,next);  //read the next unclaimed file in while we work on this one
+        // buffer this file's output so it isn't interleaved with other threads'
+        std::ostringstream log;
+        logStream() = &log;
+        fileresult r;
+        handleDirectoryFile(c,debug,files[i],i,manifests,r,parser,cmp);
+        r.log = log.str();
+        logStream() = &std::cerr;
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          finished[i] = std::move(r);
+        }
+        cv.notify_all();
+      }
+    });
+  }
+
+  // report results in order as soon as they're available
+  for (unsigned i = 0; i < files.size(); ++i) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [&]{ return finished.count(i) > 0; });
+    fileresult r = std::move(finished[i]);
+    finished.erase(i);
+    reported = i+1;
+    lock.unlock();
+    cv.notify_all();
+    std::cerr << r.log;
+    reportDirectoryFile(c,files[i],r,updates,journals,corpus);
+  }
+  for (std::thread& w : workers) {
+    w.join();
+  }
+}
+
+int handleDirectory(const cmdoptions &c, const int debug, OutputSink* corpus = nullptr) {
   // verify all of our input and output directories are valid (not files + proper write permissions)
-  if (!(c.cfile || c.outfile || c.analysisfile)) {
-    FAIL("No output directories specified with -j, -a, or -X");
+  if (!(c.cfile || c.outfile || c.analysisfile || c.colfile || c.corpusfile)) {
+    FAIL("No outputs specified with -j, -a, -X, --columnar, or --corpus");
     return -2;
   }
   if (c.outfile && (!makeDirectoryIfNotExists(c.outfile))) {
@@ -291,43 +941,146 @@ int handleDirectory(const cmdoptions &c, const int debug) {
     FAIL("Analysis output directory '" << c.analysisfile << "' is not a valid directory");
     return -2;
   }
+  if (c.colfile && (!makeDirectoryIfNotExists(c.colfile))) {
+    FAIL("Columnar output directory '" << c.colfile << "' is not a valid directory");
+    return -2;
+  }
   if (c.cfile && (!makeDirectoryIfNotExists(c.cfile))) {
     FAIL("Compression output directory '" << c.cfile << "' is not a valid directory");
     return -2;
   }
 
-  // find all slippi files in a directory
-  for (const f_entry & entry : f_iter(std::string(c.infile))) {
-    std::string base  = entry.path().filename();
-    std::string noext = entry.path().stem();
-    if (getFileExt(base).compare("slp") == 0) {
-      cmdoptions c2;
-      copyCommandOptions(c,c2);
-      stringtoChars((entry.path()).string(),&(c2.infile));
-      if(c2.cfile) {
-        stringtoChars((PATH(c.cfile) / PATH(noext+".zlp")).string(),&(c2.cfile));
-      }
-      if(c2.outfile) {
-        stringtoChars((PATH(c.outfile) / PATH(base+".json")).string(),&(c2.outfile));
+  // find all slippi files (sorted so results are reported in a deterministic order)
+  str_vec files = findDirectoryReplays(c);
+  std::sort(files.begin(),files.end());
+  removeStemCollisions(c,files);
+  makeOutputSubdirectories(c,files);
+
+  // with --incremental, check what's already been processed into each output
+  //   directory (new entries are kept separately until all workers finish,
+  //   and appended to each manifest as they're reported in case we're interrupted)
+  manifest      manifests[DirOutput::COUNT];
+  manifest      updates[DirOutput::COUNT];
+  std::ofstream journals[DirOutput::COUNT];
+  if (c.incremental) {
+    for (unsigned k = 0; k < DirOutput::COUNT; ++k) {
+      if (directoryOutput(c,k)) {
+        manifests[k] = loadManifest(directoryOutput(c,k));
+        if (!openManifestJournal(directoryOutput(c,k),journals[k])) {
+          WARN("Could not open manifest in " << directoryOutput(c,k));
+        }
       }
-      if(c2.analysisfile) {
-        stringtoChars((PATH(c.analysisfile) / PATH(noext+"-analysis.json")).string(),&(c2.analysisfile));
+    }
+  }
+
+  unsigned nthreads = std::min(c.threads,unsigned(files.size()));
+  if (nthreads <= 1) {
+    slip::Parser     parser(debug);
+    slip::Compressor cmp(debug);
+    for (unsigned i = 0; i < files.size(); ++i) {
+      prefetchDirectoryFile(c,files,i+1);  //read the next file in while we work on this one
+      fileresult r;
+      handleDirectoryFile(c,debug,files[i],i,manifests,r,parser,cmp);
+      reportDirectoryFile(c,files[i],r,updates,journals,corpus);
+    }
+  } else {
+    handleDirectoryParallel(c,debug,files,nthreads,manifests,updates,journals,corpus);
+  }
+
+  if (c.incremental) {
+    // compact each manifest down to one entry per input
+    for (unsigned k = 0; k < DirOutput::COUNT; ++k) {
+      journals[k].close();
+      for (auto& kv : updates[k]) {
+        manifests[k][kv.first] = std::move(kv.second);
       }
-      // std::cout << "  -i "   << c2.infile << std::endl;
-      // std::cout << "    -X " << c2.cfile << std::endl;
-      // std::cout << "    -j " << c2.outfile << std::endl;
-      // std::cout << "    -a " << c2.analysisfile << std::endl;
-      INFO("Processing file " << CYN << c2.infile << BLN);
-      int ret = handleSingleFile(c2,debug);
-      if (ret != 0) {
-        WARN("  Encountered errors processing input file " << RED << c2.infile << BLN);
+      if (directoryOutput(c,k) && (!saveManifest(directoryOutput(c,k),manifests[k]))) {
+        WARN("Could not save manifest in " << directoryOutput(c,k));
       }
-      cleanupCommandOptions(c2);
     }
   }
   return 0;
 }
 
+//Encode (but don't compress) a replay for training a dictionary; .zlp inputs
+//  are decoded and then encoded again
+bool encodeForTraining(slip::Compressor &cmp, const std::string &fname, std::string &encoded) {
+  uint32_t size;
+  bool     mapped;
+  char*    buf = loadReplayFile(fname.c_str(),size,mapped);
+  if (buf == nullptr) {
+    return false;
+  }
+  char*    out      = nullptr;
+  unsigned out_size = 0;
+  cmp.reset();
+  bool success = cmp.loadFromBuff(&buf,size);
+  if (success) {
+    out_size = cmp.saveToBuff(&out);
+  }
+  unmapFile(buf,size,mapped);
+  if (success && getFileExt(fname) == "zlp") {
+    cmp.reset();
+    success = cmp.loadFromBuff(&out,out_size);
+    delete[] out;
+    out = nullptr;
+    if (success) {
+      out_size = cmp.saveToBuff(&out);
+    }
+  }
+  if (success) {
+    encoded.assign(out,out_size);
+  }
+  if (out != nullptr) {
+    delete[] out;
+  }
+  cmp.reset();
+  return success;
+}
+
+int handleTrainDictionary(const cmdoptions &c, const int debug) {
+  if (!c.dirmode) {
+    FAIL("--train-dict needs a directory of replays as input");
+    return -2;
+  }
+  if (fileExists(c.traindict)) {
+    FAIL("File " << c.traindict << " exists, refusing to overwrite");
+    return -2;
+  }
+
+  // sample evenly across the (sorted) directory if there are too many replays
+  str_vec files = findDirectoryReplays(c);
+  std::sort(files.begin(),files.end());
+  unsigned nsamples = std::min(unsigned(files.size()),DICT_MAX_TRAIN_FILES);
+  std::vector<std::string> encoded;
+  slip::Compressor cmp(debug);
+  for (unsigned i = 0; i < nsamples; ++i) {
+    std::string f = (PATH(c.infile) / PATH(files[(uint64_t(i)*files.size())/nsamples])).string();
+    DOUT1("Encoding " << f);
+    encoded.emplace_back();
+    if (!encodeForTraining(cmp,f,encoded.back())) {
+      WARN("Could not encode " << f << "; skipping it");
+      encoded.pop_back();
+    }
+  }
+  std::vector<std::pair<const char*,size_t>> samples;
+  for (const std::string& e : encoded) {
+    samples.push_back({e.c_str(),e.size()});
+  }
+
+  std::string dict = trainDictionary(samples,c.dictsize);
+  if (dict.empty()) {
+    FAIL("No data shared between replays to build a dictionary from");
+    return -2;
+  }
+  std::ofstream fout(c.traindict, std::ios::binary | std::ios::out);
+  fout.write(dict.c_str(),dict.size());
+  fout.close();
+  INFO("Saved " << dict.size() << " byte dictionary " << dictionaryIdString(registerDictionary(dict.c_str(),dict.size())->id)
+    << " trained on " << samples.size() << " replays to " << c.traindict);
+  return 0;
+}
+
 int run(int argc, char** argv) {
   if (cmdOptionExists(argv, argv+argc, "-h")) {
     printUsage();
@@ -348,10 +1101,61 @@ int run(int argc, char** argv) {
     return -1;
   }
 
+  if (c.traindict) {
+    return handleTrainDictionary(c,c.debug);
+  }
+
+  FieldSelection fieldsel;
+  if (c.fields) {
+    std::string bad;
+    if (!parseFieldSelection(c.fields,fieldsel,bad)) {
+      FAIL("Unknown frame field '" << bad << "' in --fields");
+      return -1;
+    }
+    c.fieldsel = &fieldsel;
+  }
+
   if(isDirectory(c.infile)) {
-    return handleDirectory(c,c.debug);
+    if (c.statsfile) {
+      WARN("--stats is only supported for single files; ignoring it");
+      c.statsfile = nullptr;
+    }
+    if (!c.corpusfile) {
+      return handleDirectory(c,c.debug);
+    }
+    if (c.incremental) {
+      WARN("--incremental is not supported with --corpus; ignoring it");
+      c.incremental = false;
+    }
+  }
+  if (!c.corpusfile) {
+    slip::Parser     p(c.debug);
+    slip::Compressor cmp(c.debug);
+    return handleSingleFile(c,c.debug,p,cmp);
+  }
+
+  // with --corpus, every replay is appended to one file, numbered on from
+  //   the games already in it
+  OutputSink* corpus = openCorpus(c,c.gameid);
+  if (!corpus) {
+    return -2;
+  }
+  int ret;
+  if (isDirectory(c.infile)) {
+    ret = handleDirectory(c,c.debug,corpus);
+  } else {
+    slip::Parser     p(c.debug);
+    slip::Compressor cmp(c.debug);
+    std::string      rows;
+    ret = handleSingleFile(c,c.debug,p,cmp,nullptr,&rows);
+    corpus->write(rows.data(),rows.size());
+  }
+  if (!corpus->close()) {
+    FAIL("Could not write corpus file " << c.corpusfile);
+    ret = -2;
   }
-  return handleSingleFile(c,c.debug);
+  delete corpus;
+  return ret;
 }
 
 }
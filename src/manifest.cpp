@@ -0,0 +1,88 @@
+#include <sstream>
+#include <filesystem>
+
+#include "manifest.h"
+#include "util.h"
+
+namespace slip {
+
+static void writeManifestEntry(std::ostream &f, const std::string &path, const manifestentry &e) {
+  f << e.md5 << '\t' << e.size << '\t' << e.mtime << '\t' << e.output << '\t'
+    << e.version << '\t' << path << '\n';
+}
+
+manifest loadManifest(const char* dir) {
+  manifest m;
+  std::ifstream f((std::filesystem::path(dir) / MANIFEST_FILE).string());
+  std::string line;
+  while (std::getline(f,line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    // md5, size, mtime, output, version, and path, separated by tabs
+    std::istringstream ss(line);
+    manifestentry e;
+    std::string path;
+    if (std::getline(ss,e.md5,'\t') && (ss >> e.size >> e.mtime >> e.output) && ss.get() == '\t'
+      && std::getline(ss,e.version,'\t') && std::getline(ss,path) && !path.empty()) {
+      m[path] = e;
+    }
+  }
+  return m;
+}
+
+bool saveManifest(const char* dir, const manifest &m) {
+  // write to a temporary file first so an interrupted run never leaves a partial manifest
+  std::filesystem::path mpath = std::filesystem::path(dir) / MANIFEST_FILE;
+  std::filesystem::path tpath = std::filesystem::path(dir) / (MANIFEST_FILE+".tmp");
+  std::ofstream f(tpath.string());
+  f << "# slippc manifest: md5, size, mtime, output, version, path" << std::endl;
+  for (const auto& kv : m) {
+    writeManifestEntry(f,kv.first,kv.second);
+  }
+  f.close();
+  std::error_code ec;
+  std::filesystem::rename(tpath,mpath,ec);
+  return (!f.fail()) && (!ec);
+}
+
+bool openManifestJournal(const char* dir, std::ofstream &f) {
+  f.open((std::filesystem::path(dir) / MANIFEST_FILE).string(), std::ios::app);
+  if (f.is_open() && f.tellp() == 0) {
+    f << "# slippc manifest: md5, size, mtime, output, version, path" << std::endl;
+  }
+  return f.good();
+}
+
+void appendManifestEntry(std::ostream &f, const std::string &path, const manifestentry &e) {
+  writeManifestEntry(f,path,e);
+  f.flush();
+}
+
+manifestentry statManifestInput(const std::string &infile) {
+  std::error_code ec;
+  manifestentry cur;
+  cur.size  = std::filesystem::file_size(infile,ec);
+  cur.mtime = std::filesystem::last_write_time(infile,ec).time_since_epoch().count();
+  return cur;
+}
+
+bool manifestEntryCurrent(const manifestentry &e, manifestentry &cur, const std::string &version,
+  const std::string &infile, const std::string &outfile) {
+  if ((e.version != version) || (e.output && (!fileExists(outfile)))) {
+    return false;
+  }
+  if (e.size != cur.size) {
+    return false;
+  }
+  if (e.mtime == cur.mtime) {
+    return true;
+  }
+  // stat changed (e.g., the file was copied); fall back to comparing contents
+  if (cur.md5.empty()) {
+    cur.md5 = md5file(infile);
+  }
+  return e.md5 == cur.md5;
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef MANIFEST_H_
+#define MANIFEST_H_
+
+#include <string>
+#include <map>
+#include <fstream>
+
+// Manifests of the inputs already processed into each output directory,
+//   used by --incremental. A manifest is a text file with one line per input:
+//   md5, size, mtime, output, version, and path, separated by tabs. Lines
+//   starting with '#' are ignored, and a path listed more than once takes its
+//   last entry, so entries can be appended as inputs finish and the whole
+//   file compacted once a run is done.
+
+namespace slip {
+
+//Name of the manifest kept in each output directory with --incremental
+const std::string MANIFEST_FILE = "_manifest.txt";
+
+//Record of an input file that was processed into an output directory
+typedef struct _manifestentry {
+  std::string md5;             //MD5 of the input file
+  uint64_t    size    = 0;     //Size of the input file in bytes
+  int64_t     mtime   = 0;     //Last modification time of the input file
+  bool        output  = false; //Whether an output file was actually written for it
+  std::string version;         //Version of the code that wrote the output
+} manifestentry;
+
+//Manifest entries keyed by path relative to the input directory
+typedef std::map<std::string,manifestentry> manifest;
+
+//Read the manifest in an output directory (empty if there isn't one)
+manifest loadManifest(const char* dir);
+
+//Replace the manifest in an output directory with m
+bool saveManifest(const char* dir, const manifest &m);
+
+//Open the manifest in an output directory for appending entries with appendManifestEntry()
+bool openManifestJournal(const char* dir, std::ofstream &f);
+
+//Append (and flush) a single manifest entry, so it survives the run being interrupted
+void appendManifestEntry(std::ostream &f, const std::string &path, const manifestentry &e);
+
+//Size and mtime of an input file, for comparing against its manifest entry
+manifestentry statManifestInput(const std::string &infile);
+
+//Whether the output recorded by entry e is still up to date for an input
+//  whose current stats are cur: written by the given version, still present
+//  if one was written, and from the same input. If the stats differ, the
+//  input's MD5 is computed into cur and compared instead.
+bool manifestEntryCurrent(const manifestentry &e, manifestentry &cur, const std::string &version,
+  const std::string &infile, const std::string &outfile);
+
+}
+
+#endif /* MANIFEST_H_ */
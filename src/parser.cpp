@@ -8,64 +8,99 @@ namespace slip {
   }
 
   Parser::~Parser() {
-    if (_rb != nullptr) {
-      delete [] _rb;
-    }
+    _releaseBuffer();
     _cleanup();
+    if (_decoder != nullptr) {
+      delete _decoder;
+    }
+  }
+
+  void Parser::reset() {
+    _releaseBuffer();
+    _replay.reset();
+    memset(_payload_sizes,0,sizeof(_payload_sizes));
+    _slippi_version.clear();
+    _slippi_maj     = 0;
+    _slippi_min     = 0;
+    _slippi_rev     = 0;
+    _max_frames     = 0;
+    _game_end_found = false;
+    _is_encoded     = false;
+    _bp             = 0;
+  }
+
+  void Parser::_releaseBuffer() {
+    if (!_rb_shared) {
+      unmapFile(_rb,_file_size,_rb_mapped);
+    }
+    _rb        = nullptr;
+    _rb_mapped = false;
+    _rb_shared = false;
   }
 
   bool Parser::load(const char* replayfilename) {
     DOUT1("  Loading " << replayfilename);
-    _replay.original_file = std::string(replayfilename);
-    std::ifstream myfile;
-    myfile.open(replayfilename,std::ios::binary | std::ios::in);
-    if (myfile.fail()) {
+    _releaseBuffer();
+
+    // Map the file directly into memory (decompressing it if necessary);
+    //   uncompressed replays are parsed straight from the mapped pages
+    _rb = loadReplayFile(replayfilename,_file_size,_rb_mapped);
+    if (_rb == nullptr) {
       FAIL("  File " << replayfilename << " could not be opened or does not exist");
       return false;
     }
+    return _load(replayfilename);
+  }
 
-    myfile.seekg(0, myfile.end);
-    _file_size = myfile.tellg();
+  bool Parser::loadFromSharedBuff(char* buffer, uint32_t size, const char* replayfilename) {
+    DOUT1("  Loading " << replayfilename << " from shared buffer");
+    _releaseBuffer();
+    _rb        = buffer;
+    _file_size = size;
+    _rb_shared = true;
+    return _load(replayfilename);
+  }
+
+  bool Parser::_load(const char* replayfilename) {
+    _replay.original_file = std::string(replayfilename);
     if (_file_size < MIN_REPLAY_LENGTH) {
       FAIL("  File " << replayfilename << " is too short to be a valid Slippi replay");
       return false;
     }
     DOUT1("  File Size: " << +_file_size);
-    myfile.seekg(0, myfile.beg);
-
-    _rb = new char[_file_size];
-    myfile.read(_rb,_file_size);
-    myfile.close();
-
-    // Check if we have a compressed .zlp file
-    bool is_compressed = same4(&_rb[0],LZMA_HEADER);
-    if (is_compressed) {
-      DOUT1("  Decompressing file");
-      // Decompress the read buffer
-      std::string decomp = decompressWithLzma(_rb, _file_size);
-      // Get the new file size
-      _file_size    = decomp.size();
-      // Delete the old read buffer
-      delete[] _rb;
-      // Reallocate it with more spce
-      _rb = new char[_file_size];
-      // Copy buffer from the decompressed string
-      memcpy(_rb,decomp.c_str(),_file_size);
-      DOUT1("  Decompressed File Size: " << +_file_size);
+
+    // Blocked .zlp files are reassembled into a raw replay first
+    if (Compressor::isBlocked(_rb,_file_size)) {
+      uint32_t size;
+      char*    decoded = Compressor::decodeBlocked(_rb,_file_size,size);
+      if (decoded == nullptr) {
+        FAIL_CORRUPT("  Could not decode blocked file " << replayfilename);
+        return false;
+      }
+      _releaseBuffer();
+      _rb        = decoded;
+      _file_size = size;
     }
 
     bool status = this->_parse();
     // if we attempted to parse an encoded replay
     if (_is_encoded) {
       DOUT1("  File was encoded, decoding" << +_file_size);
-      // Create a Compressor object
-      Compressor *d  = new slip::Compressor(0);
+      // Create (or reuse) a Compressor object
+      if (_decoder == nullptr) {
+        _decoder = new slip::Compressor(0);
+      } else {
+        _decoder->reset();
+      }
       // Decompress the buffer
-      d->loadFromBuff(&_rb,_file_size);
-      // Save it back to the original buffer
-      d->saveToBuff(&_rb);
-      // Unset encoded state
+      _decoder->loadFromBuff(&_rb,_file_size);
+      // Replace the read buffer with the decoded one
+      _releaseBuffer();
+      _decoder->saveToBuff(&_rb);
+      _decoder->reset();
+      // Unset encoded state and forget the payload sizes we already read
       _is_encoded = false;
+      memset(_payload_sizes,0,sizeof(_payload_sizes));
       // restart the parsing process
       status = this->_parse();
     }
@@ -206,7 +241,7 @@ namespace slip {
         case Event::PRE_FRAME:   success = _parsePreFrame();   break;
         case Event::POST_FRAME:  success = _parsePostFrame();  break;
         case Event::GAME_END:    success = _parseGameEnd();    break;
-        case Event::ITEM_UPDATE: success = _parseItemUpdate(); break;
+        case Event::ITEM_UPDATE: success = (_fields && _fields->item.none()) || _parseItemUpdate(); break;
 
         case Event::SPLIT_MSG:   success = true;               break;
         case Event::FRAME_START: success = true;               break;
@@ -385,12 +420,45 @@ namespace slip {
       _replay.tiebreaker_number= readBE4U(&_rb[_bp+O_TIEBREAKER_NUMBER]);
     }
 
-    _max_frames = getMaxNumFrames();
+    _max_frames = _countFrames();
     _replay.setFrames(_max_frames);
-    DOUT1("    Estimated " << _max_frames << " gameplay frames (" << (_replay.frame_count) << " total frames)");
+    DOUT1("    Found " << _max_frames << " gameplay frames (" << (_replay.frame_count) << " total frames)");
     return true;
   }
 
+  int32_t Parser::_countFrames() {
+    // walk the remaining events once, reading only event codes and frame
+    //   numbers, so frame arrays can be allocated at exactly the right size
+    int32_t  max_fnum = LOAD_FRAME;
+    unsigned bp       = _bp+_payload_sizes[Event::GAME_START];
+    uint32_t remain   = _length_raw-_payload_sizes[Event::GAME_START];
+    while (remain > 0) {
+      unsigned ev_code = uint8_t(_rb[bp]);
+      unsigned shift   = _payload_sizes[ev_code];
+      if (shift == 0 || shift > remain) {
+        break;  //Let _parseEvents() complain about this
+      }
+      if (ev_code == Event::GAME_END) {
+        break;
+      }
+      if (ev_code == Event::PRE_FRAME || ev_code == Event::POST_FRAME || ev_code == Event::ITEM_UPDATE) {
+        int32_t fnum = readBE4S(&_rb[bp+O_FRAME]);
+        if (fnum > max_fnum) {
+          max_fnum = fnum;
+        }
+      }
+      remain -= shift;
+      bp     += shift;
+    }
+
+    // never exceed the estimate from the raw size, so corrupt frame
+    //   indices are still caught (and don't trigger huge allocations)
+    int32_t maxframes = std::min(max_fnum,getMaxNumFrames()-1)+1;
+    DOUT1("    Scanned " << (maxframes-LOAD_FRAME) << " frames (estimate was "
+      << (getMaxNumFrames()-LOAD_FRAME) << ")");
+    return maxframes;
+  }
+
   bool Parser::_parsePreFrame() {
     DOUT2("  Parsing pre frame event at byte " << +_bp);
     int32_t fnum = readBE4S(&_rb[_bp+O_FRAME]);
@@ -757,6 +825,7 @@ namespace slip {
 
   Analysis* Parser::analyze() {
     Analyzer a(_debug);
+    _replay.buildColumns();  //Let the analyzer read its hottest fields column-wise
     return a.analyze(_replay);
   }
 
@@ -765,16 +834,42 @@ namespace slip {
   }
 
   std::string Parser::asJson(bool delta) {
-    return _replay.replayAsJson(delta);
+    return _replay.replayAsJson(delta,_fields);
   }
 
-  void Parser::save(const char* outfilename,bool delta) {
+  void Parser::writeJson(OutputSink& out,bool delta) {
+    _replay.writeJson(out,delta,_fields);
+  }
+
+  bool Parser::save(const char* outfilename,bool delta) {
     DOUT1("  Saving JSON");
-    std::ofstream ofile2;
-    ofile2.open(outfilename);
-    ofile2 << asJson(delta) << std::endl;
-    ofile2.close();
+    OutputSink out(outfilename);
+    writeJson(out,delta);
+    out << "\n";
+    if (!out.close()) {
+      FAIL("Failed to write JSON to " << outfilename);
+      return false;
+    }
+    DOUT1("  Saved to " << outfilename);
+    return true;
+  }
+
+  void Parser::writeColumns(OutputSink& out) {
+    ColumnarWriter w(out);
+    w.fileHeader();
+    writeReplayColumns(_replay,w,0,_fields);
+  }
+
+  bool Parser::saveColumns(const char* outfilename) {
+    DOUT1("  Saving columnar data");
+    OutputSink out(outfilename);
+    writeColumns(out);
+    if (!out.close()) {
+      FAIL("Failed to write columnar data to " << outfilename);
+      return false;
+    }
     DOUT1("  Saved to " << outfilename);
+    return true;
   }
 
 }
@@ -11,10 +11,11 @@
 #include "analyzer.h"
 #include "schema.h"
 #include "compressor.h"
+#include "columnar.h"
 
 // Replay File (.slp) Spec: https://github.com/project-slippi/slippi-wiki/blob/master/SPEC.md
 
-const std::string PARSER_VERSION = "0.8.0";
+const std::string PARSER_VERSION = "0.8.1";
 
 namespace slip {
 
@@ -32,10 +33,15 @@ private:
   bool            _is_encoded     = false;   //Whether this file is encoded by the compressor
 
   char*           _rb = nullptr; //Read buffer
+  bool            _rb_mapped = false; //Whether the read buffer is a memory-mapped file
+  bool            _rb_shared = false; //Whether the read buffer is owned by someone else
   unsigned        _bp; //Current position in buffer
   uint32_t        _length_raw; //Remaining length of raw payload
   uint32_t        _length_raw_start; //Total length of raw payload
   uint32_t        _file_size; //Total size of the replay file on disk
+  Compressor*     _decoder = nullptr; //Compressor reused for decoding encoded replays
+  const FieldSelection* _fields = nullptr; //Frame fields to output (null = all of them)
+  bool            _load(const char* replayfilename); //Parse the read buffer, decoding it first if necessary
   bool            _parse(); //Internal main parsing funnction
   bool            _parseHeader();
   bool            _parseEventDescriptions();
@@ -46,14 +52,27 @@ private:
   bool            _parseGameEnd();
   bool            _parseItemUpdate();
   bool            _parseMetadata();
+  int32_t         _countFrames(); //Scan ahead for the exact number of frames in the replay
   void            _cleanup(); //Cleanup replay data
+  void            _releaseBuffer(); //Unmap / free the read buffer
 public:
   Parser(int debug_level);               //Instantiate the parser (possibly in debug mode)
   ~Parser();                             //Destroy the parser
+  void reset();                          //Forget the loaded replay so another replay can be loaded
   bool load(const char* replayfilename); //Load a replay file
+  bool loadFromSharedBuff(char* buffer, uint32_t size, const char* replayfilename); //Parse a caller-owned, already-loaded replay
   Analysis* analyze();                   //Analyze the loaded replay file
   std::string asJson(bool delta);        //Convert the parsed replay structure to a JSON
-  void save(const char* outfilename,bool delta); //Save a replay file
+  void writeJson(OutputSink& out,bool delta); //Stream the parsed replay structure as a JSON
+  bool save(const char* outfilename,bool delta); //Save a replay file
+  void writeColumns(OutputSink& out);    //Stream the parsed replay in binary columnar (.slpc) format
+  bool saveColumns(const char* outfilename); //Save the parsed replay in binary columnar (.slpc) format
+  //Only output the selected frame fields from now on (null = all of them), and
+  //  skip parsing item events entirely if no item fields are selected; the
+  //  selection must outlive the parser
+  inline void setFields(const FieldSelection* fields) {
+    _fields = fields;
+  }
 
   //Getter function for exposing read-only access to underlying replay
   inline const SlippiReplay* replay() const {
@@ -62,6 +81,7 @@ public:
 
   //Estimate the maximum number of frames stored in the file
   //  -> Assumes only two people are alive for the whole match / one ice climber
+  //  -> Used as an upper bound on the exact count from _countFrames()
   inline int32_t getMaxNumFrames() {
     //Get the base size for the file
     unsigned base_size = 0;
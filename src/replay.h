@@ -3,9 +3,13 @@
 
 #include <iostream>
 #include <fstream>
+#include <bitset>
+#include <vector>
+#include <stddef.h>
 
 #include "enums.h"
 #include "util.h"
+#include "sink.h"
 
 // Replay File (.slp) Spec: https://github.com/project-slippi/project-slippi/wiki/Replay-File-Spec
 
@@ -71,6 +75,26 @@ struct SlippiFrame {
   uint32_t anim_index    = 0;      //Animation index (used for Wait)
 };
 
+//Columnar (structure-of-arrays) copy of the SlippiFrame fields most often
+//  read by the analyzer, so passes that only look at one or two fields per
+//  frame don't have to pull whole SlippiFrames through the cache
+struct SlippiFrameColumns {
+  std::vector<uint16_t> action_pre;   //SlippiFrame::action_pre for each frame
+  std::vector<uint16_t> action_post;  //SlippiFrame::action_post for each frame
+  std::vector<uint16_t> buttons;      //SlippiFrame::buttons for each frame
+  std::vector<uint8_t>  flags_4;      //SlippiFrame::flags_4 for each frame
+  std::vector<uint8_t>  l_cancel;     //SlippiFrame::l_cancel for each frame
+  std::vector<uint8_t>  airborne;     //SlippiFrame::airborne for each frame (bytes, not a packed vector<bool>)
+  std::vector<float>    hitstun;      //SlippiFrame::hitstun for each frame
+  std::vector<float>    percent_post; //SlippiFrame::percent_post for each frame
+
+  void build(const SlippiFrame* frame, uint32_t frame_count);
+  void cleanup();
+  inline bool built() const {
+    return not action_pre.empty();
+  }
+};
+
 struct SlippiItemFrame {
   int32_t  frame         = 0;  //In-game frame number corresponding to this SlippiItemFrame
   uint8_t  state         = 0;  //Item state (undocumented)
@@ -124,9 +148,11 @@ struct SlippiPlayer {
   std::string  disp_name    = "";      //Display name used on Slippi Online
   std::string  slippi_uid   = "";      //Firebase UID of Slippi player
   SlippiFrame* frame        = nullptr; //Pointer to array of data for player's individual frames
+  SlippiFrameColumns cols;             //Optional columnar copy of frame data (see SlippiReplay::buildColumns())
 };
 
-struct SlippiReplay {
+//Game-level information about a replay (everything but per-player and per-item data)
+struct SlippiGameInfo {
   unsigned        errors              = 0;          //Number of errors that occurred during parsing
   uint32_t        slippi_version_raw  = 0;          //Raw Slippi version number
   std::string     slippi_version      = "";         //String representation of Slippi version number
@@ -182,12 +208,30 @@ struct SlippiReplay {
   bool            sudden_death        = false;      //Whether bombs start dropping after 20 seconds
   uint32_t        num_items           = 0;          //Number of distinct item IDs encountered during the game
   uint8_t         language            = 0;          //Language option (0 = Japanese, 1 = English)
+};
+
+//Subset of SlippiFrame / SlippiItemFrame fields to parse and output (see
+//  parseFieldSelection() in columnar.h), marked by each field's offset in its struct
+struct FieldSelection {
+  std::bitset<sizeof(SlippiFrame)>     frame;  //Selected SlippiFrame fields
+  std::bitset<sizeof(SlippiItemFrame)> item;   //Selected SlippiItemFrame fields (none = skip items entirely)
+};
+
+//Whether field of struct S is selected (everything is if there's no selection)
+#define SELECTED(sel,set,S,field) (((sel) == nullptr) || (sel)->set[offsetof(S,field)])
+
+struct SlippiReplay : SlippiGameInfo {
   SlippiPlayer    player[8]           = {};         //Array of SlippiPlayers (1 main + follower for each port)
   SlippiItem      item[MAX_ITEMS]     = {};         //Array of SlippiItems (can track up to MAX_ITEMS per game)
 
   void setFrames(int32_t max_frames);
+  void buildColumns(); //Fill in the columnar frame store for every player
   void cleanup();
-  std::string replayAsJson(bool delta);
+  void reset();        //Free frame data and restore defaults, touching only the items actually used
+  //Convert the replay to a JSON held in memory, with only the selected frame fields (or all if fields is null)
+  std::string replayAsJson(bool delta, const FieldSelection* fields = nullptr) const;
+  //Stream the replay as a JSON to out, with only the selected frame fields (or all if fields is null)
+  void writeJson(OutputSink& out, bool delta, const FieldSelection* fields = nullptr) const;
 };
 
 
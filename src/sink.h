@@ -0,0 +1,160 @@
+#ifndef SINK_H_
+#define SINK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <functional>
+#include <charconv>
+
+// Buffered output sink for streaming large text outputs (e.g., full-frame
+//   JSON) without building them in memory first. Output collects in a fixed
+//   size buffer and is handed to a file, stdout, or a callback one chunk at a
+//   time, so memory use stays the same however long the replay is. Numbers
+//   are formatted with std::to_chars straight into the buffer (floats in the
+//   shortest form that reads back as the same value), skipping the locale
+//   and stream state machinery of std::ostream.
+
+const size_t SINK_BUFFER_SIZE = 1 << 16;  //Bytes collected before each write to the destination
+const size_t SINK_NUM_CHARS   = 32;       //Room reserved for formatting any one number
+
+//A JSON object key, written with its indentation as `<indent>"key" : `
+struct JsonKey {
+  unsigned    indent;  //Number of spaces before the key
+  const char* str;     //Key name (without quotes)
+  size_t      len;     //Length of the key name
+
+  //Key name is a string literal, so its length is known at compile time
+  template<size_t N>
+  inline JsonKey(unsigned i, const char (&k)[N]) : indent(i), str(k), len(N-1) {}
+  inline JsonKey(unsigned i, const std::string& k) : indent(i), str(k.data()), len(k.size()) {}
+};
+
+class OutputSink {
+public:
+  typedef std::function<void(const char*,size_t)> Callback;  //Receives each chunk of output
+
+private:
+  char*    _buf   = nullptr;  //Output collected since the last flush
+  size_t   _used  = 0;        //Bytes of _buf in use
+  uint64_t _sent  = 0;        //Bytes passed on to the destination so far
+  FILE*    _file  = nullptr;  //File written to, if not using a callback
+  bool     _owned = false;    //Whether we opened (and so must close) _file
+  bool     _ok    = true;     //False once any write has failed
+  Callback _cb;               //Callback written to, if not using a file
+
+  inline void _emit(const char* data, size_t len) {
+    if (len == 0) {
+      return;
+    }
+    _sent += len;
+    if (_cb) {
+      _cb(data,len);
+    } else if (_file == nullptr || fwrite(data,1,len,_file) != len) {
+      _ok = false;
+    }
+  }
+
+  //Make room for at least len more bytes in the buffer and return where they go
+  inline char* _reserve(size_t len) {
+    if (_used + len > SINK_BUFFER_SIZE) {
+      _emit(_buf,_used);
+      _used = 0;
+    }
+    return &_buf[_used];
+  }
+
+  template<typename T>
+  inline OutputSink& _number(T n) {
+    char* b = _reserve(SINK_NUM_CHARS);
+    _used += std::to_chars(b,b+SINK_NUM_CHARS,n).ptr - b;
+    return *this;
+  }
+
+public:
+  explicit OutputSink(FILE* file) : _buf(new char[SINK_BUFFER_SIZE]), _file(file) {}
+  explicit OutputSink(const char* fname, bool append = false)
+    : _buf(new char[SINK_BUFFER_SIZE]), _file(fopen(fname,append ? "ab" : "wb")), _owned(true) {
+    _ok = (_file != nullptr);
+    if (_ok && append) {  //Positions count from the start of the file, not where we started appending
+      fseeko(_file,0,SEEK_END);
+      _sent = ftello(_file);
+    }
+  }
+  explicit OutputSink(Callback cb) : _buf(new char[SINK_BUFFER_SIZE]), _cb(cb) {}
+  OutputSink(const OutputSink&) = delete;
+  OutputSink& operator=(const OutputSink&) = delete;
+  ~OutputSink() {
+    close();
+    delete[] _buf;
+  }
+
+  //Whether every write so far has succeeded
+  inline bool ok() const { return _ok; }
+
+  //Mark the output as bad (e.g., when the caller detects it wrote something inconsistent)
+  inline void invalidate() { _ok = false; }
+
+  //Total bytes written to the sink so far
+  inline uint64_t position() const { return _sent + _used; }
+
+  //Pass everything buffered on to the destination
+  inline void flush() {
+    _emit(_buf,_used);
+    _used = 0;
+    if (_file != nullptr && fflush(_file) != 0) {
+      _ok = false;
+    }
+  }
+
+  //Flush and close the destination (if we opened it); returns whether all output was written
+  inline bool close() {
+    flush();
+    if (_owned && _file != nullptr) {
+      if (fclose(_file) != 0) {
+        _ok = false;
+      }
+    }
+    _file  = nullptr;
+    _owned = false;
+    _cb    = nullptr;
+    return _ok;
+  }
+
+  inline void write(const char* data, size_t len) {
+    if (_used + len > SINK_BUFFER_SIZE) {
+      _emit(_buf,_used);
+      _used = 0;
+      if (len >= SINK_BUFFER_SIZE) {  //Too big to buffer, so pass it straight through
+        _emit(data,len);
+        return;
+      }
+    }
+    memcpy(&_buf[_used],data,len);
+    _used += len;
+  }
+
+  inline OutputSink& operator<<(const char* s)        { write(s,strlen(s));      return *this; }
+  inline OutputSink& operator<<(const std::string& s) { write(s.data(),s.size()); return *this; }
+  inline OutputSink& operator<<(char c)               { write(&c,1);              return *this; }
+  inline OutputSink& operator<<(int32_t n)           { return _number(n); }
+  inline OutputSink& operator<<(uint32_t n)          { return _number(n); }
+  inline OutputSink& operator<<(float n)             { return _number(n); }
+  inline OutputSink& operator<<(const JsonKey& k) {
+    if (k.indent + k.len + 5 > SINK_BUFFER_SIZE) {  //Absurdly long key, so skip the fast path
+      write(std::string(k.indent,' ').c_str(),k.indent);
+      return (*this) << "\"" << std::string(k.str,k.len) << "\" : ";
+    }
+    char* b = _reserve(k.indent + k.len + 5);
+    memset(b,' ',k.indent);
+    b   += k.indent;
+    *b++ = '"';
+    memcpy(b,k.str,k.len);
+    memcpy(b+k.len,"\" : ",4);
+    _used += k.indent + k.len + 5;
+    return *this;
+  }
+};
+
+#endif /* SINK_H_ */
@@ -17,9 +17,14 @@ static const std::string TCMPFILE      = "3-7-0-singles-net.slp.xz";
 static const std::string TZLPFILE      = "zlptest.zlp";
 // temporary zlp file
 static const std::string TUNZLPFILE    = "zlptest.slp";
+// temporary corpus file
+static const std::string TSLPCFILE     = "corpustest.slpc";
+// temporary directory for --incremental manifests
+static const std::string TMANIFESTDIR  = "manifesttest";
 
 static const std::string tmpzlp        = (PATH(TESTDIR) / PATH(TZLPFILE)).string();
 static const std::string tmpunzlp      = (PATH(TESTDIR) / PATH(TUNZLPFILE)).string();
+static const std::string tmpslpc       = (PATH(TESTDIR) / PATH(TSLPCFILE)).string();
 
 typedef std::filesystem::directory_iterator f_iter;
 typedef std::filesystem::directory_entry    f_entry;
@@ -240,6 +245,27 @@ int testKnownFiles() {
     ASSERT("MD5 of file is 8ba0485603d5d99cdfd8cead63ba6c1f",test_md5.compare("8ba0485603d5d99cdfd8cead63ba6c1f") == 0,
       "MD5 of file is " << test_md5);
     BAILONFAIL(1);
+    uint32_t xz_size   = 0;
+    bool     xz_mapped = false;
+    char*    xz_buf    = mapFile(known1.c_str(),xz_size,xz_mapped);
+    uint64_t xz_hint = lzmaUncompressedSize(reinterpret_cast<uint8_t*>(xz_buf),xz_size);
+    ASSERT("Uncompressed size from .xz index is 4146631",xz_hint == 4146631,
+      "Uncompressed size from .xz index is " << xz_hint);
+    unmapFile(xz_buf,xz_size,xz_mapped);
+    //Files too large for a 32-bit size are rejected rather than mapped or read truncated
+    //  (the file is sparse, so this doesn't actually write 4 GB)
+    std::string huge = tmpzlp+".huge";
+    std::ofstream(huge).close();
+    std::filesystem::resize_file(huge,uint64_t(UINT32_MAX)+2);
+    uint32_t huge_size   = 0;
+    bool     huge_mapped = false;
+    char*    huge_buf    = mapFile(huge.c_str(),huge_size,huge_mapped);
+    char*    huge_read   = readFile(huge.c_str(),huge_size);
+    ASSERT("Files Over 4 GB are Rejected",huge_buf == nullptr && huge_read == nullptr,
+      "File of " << std::filesystem::file_size(huge) << " bytes was loaded as " << huge_size << " bytes");
+    unmapFile(huge_buf,huge_size,huge_mapped);
+    if (huge_read != nullptr) { delete[] huge_read; }
+    remove(huge.c_str());
     p = new slip::Parser(_debug);
     ASSERT("File Parses",p->load((known1).c_str()),
       "File does not parse");
@@ -330,6 +356,9 @@ int testKnownFiles() {
     ASSERTNOERR("Compressor Loads File",loaded,
       "Compressor failed to load known file");
     BAILONFAIL(1);
+    ASSERT("Compressor Validates File In Place",c->validate(Validate::FAST),
+      "Compressor failed to validate known file in place");
+    BAILONFAIL(1);
     ASSERT("Compressor Validates File",c->validate(),
       "Compressor failed to validate known file");
     BAILONFAIL(1);
@@ -337,12 +366,56 @@ int testKnownFiles() {
     ASSERT("Compressed File is Generated",access( tmpzlp.c_str(), F_OK ) == 0,
       "Compressor failed to save compressed output file");
     BAILONFAIL(1);
+    const slip::CompressorStats &st = c->stats();
+    ASSERT("Stats Output Size Matches Compressed File",st.out_size == std::filesystem::file_size(tmpzlp),
+      "Stats output size is " << st.out_size);
+    ASSERT("Stats Shuffle Every Pre-frame and Post-frame Byte",st.ev_len[Event::PRE_FRAME] == st.ev_bytes[Event::PRE_FRAME]
+      && st.ev_len[Event::POST_FRAME] == st.ev_bytes[Event::POST_FRAME] && st.ev_bytes[Event::PRE_FRAME] > 0,
+      "Stats shuffled " << st.ev_len[Event::PRE_FRAME] << " / " << st.ev_bytes[Event::PRE_FRAME] << " pre-frame bytes");
+    ASSERT("Stats Count Velocity Predictions",st.preds[Predictor::VELOCITY] > st.fails[Predictor::VELOCITY],
+      "Stats count " << st.preds[Predictor::VELOCITY] << " hits and " << st.fails[Predictor::VELOCITY] << " misses");
+    ASSERT("Stats Time Validation",st.wall_ms[PipelineStage::VALIDATE] > 0 && st.wall_ms[PipelineStage::COMPRESS] > 0,
+      "Stats timed validation at " << st.wall_ms[PipelineStage::VALIDATE] << " ms");
     delete c;
 
     std::string test_md5_z = md5file(tmpzlp.c_str());
     SUGGEST("MD5 of compressed file is 8af440882c30c4ac29b935ae3d588e03",test_md5_z.compare("8af440882c30c4ac29b935ae3d588e03") == 0,
       "MD5 of file is " << test_md5_z << ", compression algorithm may have changed");
 
+    uint32_t shared_size = 0;
+    bool     shared_mapped;
+    char*    shared = loadReplayFile(tmpzlp.c_str(),shared_size,shared_mapped);
+    p = new slip::Parser(_debug);
+    ASSERT("Parser Loads Compressed File From Shared Buffer",p->loadFromSharedBuff(shared,shared_size,tmpzlp.c_str()),
+      "Parser failed to load compressed known file from a shared buffer");
+    delete p;
+    c = new slip::Compressor(_debug);
+    ASSERT("Compressor Loads Compressed File From Same Shared Buffer",c->loadFromSharedBuff(shared,shared_size,tmpzlp.c_str()),
+      "Compressor failed to load compressed known file from a shared buffer");
+    delete c;
+    unmapFile(shared,shared_size,shared_mapped);
+
+    //A frame event with an out-of-range player byte is rejected, not shuffled into another event's bin
+    uint32_t corrupt_size = 0;
+    bool     corrupt_mapped;
+    char*    corrupt = loadReplayFile(known1.c_str(),corrupt_size,corrupt_mapped);
+    std::string corrupt_copy(corrupt,corrupt_size);
+    unmapFile(corrupt,corrupt_size,corrupt_mapped);
+    uint16_t corrupt_sizes[256] = {0};
+    uint32_t cb = 15;  //First event (payload sizes) follows the raw data header
+    corrupt_sizes[0x35] = uint8_t(corrupt_copy[cb+1]);
+    for (uint32_t i = 0; i+3 < corrupt_sizes[0x35]; i += 3) {
+      corrupt_sizes[uint8_t(corrupt_copy[cb+2+i])] = (uint8_t(corrupt_copy[cb+3+i]) << 8) | uint8_t(corrupt_copy[cb+4+i]);
+    }
+    while (cb < corrupt_copy.size() && uint8_t(corrupt_copy[cb]) != Event::POST_FRAME && corrupt_sizes[uint8_t(corrupt_copy[cb])] > 0) {
+      cb += 1+corrupt_sizes[uint8_t(corrupt_copy[cb])];
+    }
+    corrupt_copy[cb+O_PLAYER] = char(0xFF);
+    c = new slip::Compressor(_debug);
+    ASSERT("Compressor Rejects Invalid Player Index",!c->loadFromSharedBuff(&corrupt_copy[0],corrupt_copy.size(),known1.c_str()),
+      "Compressor accepted a frame event for player 255");
+    delete c;
+
     c = new slip::Compressor(_debug);
     ASSERT("Compressor Loads Compressed File",c->loadFromFile(tmpzlp.c_str()),
       "Compressor failed to load compressed known file");
@@ -360,6 +433,350 @@ int testKnownFiles() {
     ASSERT("MD5 of restored file is 7ea1aa5b49f87ab77a66bd8541810d50",test_md5_3.compare("7ea1aa5b49f87ab77a66bd8541810d50") == 0,
       "MD5 of restored file is " << test_md5_3);
 
+    //Same round trip through the LZ codec
+    remove(tmpzlp.c_str());
+    remove(tmpunzlp.c_str());
+    c = new slip::Compressor(_debug);
+    c->setOutputFilename(tmpzlp.c_str());
+    c->setCodec(Codec::LZ);
+    ASSERT("Compressor Loads File for LZ",c->loadFromFile(known2.c_str()),
+      "Compressor failed to load known file for LZ");
+    BAILONFAIL(1);
+    c->saveToFile(false);
+    delete c;
+    uint32_t lz_size = 0;
+    bool     lz_mapped;
+    char*    lz_buf = mapFile(tmpzlp.c_str(),lz_size,lz_mapped);
+    ASSERT("LZ Compressed File is Tagged as LZ",lz_buf != nullptr && detectCodec(lz_buf,lz_size) == Codec::LZ,
+      "LZ compressed file is missing its codec tag");
+    unmapFile(lz_buf,lz_size,lz_mapped);
+    c = new slip::Compressor(_debug);
+    ASSERT("Compressor Loads LZ Compressed File",c->loadFromFile(tmpzlp.c_str()),
+      "Compressor failed to load LZ compressed known file");
+    BAILONFAIL(1);
+    c->saveToFile(false);
+    delete c;
+    std::string test_md5_4 = md5file(tmpunzlp.c_str());
+    ASSERT("MD5 of file restored from LZ is 7ea1aa5b49f87ab77a66bd8541810d50",test_md5_4.compare("7ea1aa5b49f87ab77a66bd8541810d50") == 0,
+      "MD5 of file restored from LZ is " << test_md5_4);
+
+    //Reusing a compressor / parser after reset() gives the same results as a fresh one
+    c = new slip::Compressor(_debug);
+    ASSERT("Fresh Compressor Loads File",c->loadFromFile(known2.c_str()),
+      "Fresh compressor failed to load known file");
+    BAILONFAIL(1);
+    char*    fresh_enc;
+    unsigned fresh_enc_size = c->saveToBuff(&fresh_enc);
+    delete c;
+    c = new slip::Compressor(_debug);
+    c->loadFromFile(known1.c_str());
+    c->validate();
+    c->reset();
+    ASSERT("Reused Compressor Loads File",c->loadFromFile(known2.c_str()),
+      "Reused compressor failed to load known file");
+    BAILONFAIL(1);
+    char*    reused_enc;
+    unsigned reused_enc_size = c->saveToBuff(&reused_enc);
+    ASSERT("Reused Compressor Encodes Like a Fresh One",reused_enc_size == fresh_enc_size && memcmp(reused_enc,fresh_enc,fresh_enc_size) == 0,
+      "Reused compressor's encoding differs from a fresh compressor's");
+    ASSERT("Reused Compressor Validates File",c->validate(),
+      "Reused compressor failed to validate known file");
+    delete c;
+    delete[] fresh_enc;
+    delete[] reused_enc;
+
+    p = new slip::Parser(_debug);
+    p->load(known2.c_str());
+    std::string fresh_json = p->asJson(true);
+    delete p;
+    p = new slip::Parser(_debug);
+    p->load(known1.c_str());
+    p->reset();
+    ASSERT("Reused Parser Loads File",p->load(known2.c_str()),
+      "Reused parser failed to load known file");
+    ASSERT("Reused Parser Outputs the Same JSON as a Fresh One",p->asJson(true) == fresh_json,
+      "Reused parser's JSON differs from a fresh parser's");
+
+    //Streaming JSON arrives in buffer-sized chunks that add up to the in-memory JSON
+    std::string streamed_json;
+    size_t      largest_chunk = 0;
+    OutputSink  json_sink([&](const char* data, size_t len) {
+      streamed_json.append(data,len);
+      largest_chunk = std::max(largest_chunk,len);
+    });
+    p->writeJson(json_sink,false);
+    json_sink.close();
+    ASSERT("Streamed JSON Matches In-Memory JSON",streamed_json == p->asJson(false),
+      "Streamed JSON differs from in-memory JSON");
+    ASSERT("Streamed JSON is Written in Bounded Chunks",largest_chunk > 0 && largest_chunk <= SINK_BUFFER_SIZE,
+      "Largest streamed JSON chunk is " << largest_chunk << " bytes");
+    delete p;
+
+    //Numbers are written in the shortest form that reads back as the same value
+    std::string formatted;
+    {
+      OutputSink fmt([&formatted](const char* data, size_t len) { formatted.append(data,len); });
+      fmt << JsonKey(2,"x") << 0.1f << "," << -55.0f << "," << 0.007142857f << "," << int32_t(-123) << "," << uint32_t(4294967295u);
+    }
+    ASSERT("JSON Numbers Use Shortest Round-Trip Formatting",formatted == "  \"x\" : 0.1,-55,0.007142857,-123,4294967295",
+      "JSON numbers were formatted as " << formatted);
+
+    //Columnar output is a series of aligned, self-describing tables with a row per player frame
+    p = new slip::Parser(_debug);
+    p->load(known2.c_str());
+    std::string cols;
+    {
+      OutputSink col_sink([&cols](const char* data, size_t len) { cols.append(data,len); });
+      p->writeColumns(col_sink);
+    }
+    uint64_t expected_rows = 0;
+    for (unsigned i = 0; i < 8; ++i) {
+      if (p->replay()->player[i].frame != nullptr) {
+        expected_rows += p->replay()->frame_count;
+      }
+    }
+    delete p;
+    ASSERT("Columnar Output Starts with a Header",cols.size() >= 8 && cols.compare(0,4,"SLPC") == 0,
+      "Columnar output is missing its SLPC header");
+    std::string table_names;
+    uint64_t    frame_rows = UINT64_MAX;
+    size_t      cpos       = 8;
+    while (cpos + 16 <= cols.size() && cols.compare(cpos,4,"TABL") == 0) {
+      uint16_t nlen, ncols;
+      uint64_t rows;
+      memcpy(&nlen,&cols[cpos+4],2);
+      std::string tname = cols.substr(cpos+6,nlen);
+      memcpy(&rows,&cols[cpos+6+nlen],8);
+      memcpy(&ncols,&cols[cpos+14+nlen],2);
+      cpos += 16+nlen;
+      for (unsigned i = 0; i < ncols; ++i) {
+        uint16_t clen;
+        memcpy(&clen,&cols[cpos],2);
+        cpos += 3+clen;
+      }
+      for (unsigned i = 0; i < ncols; ++i) {
+        uint64_t blen;
+        cpos = (cpos+7) & ~size_t(7);
+        memcpy(&blen,&cols[cpos],8);
+        cpos += 8+blen;
+      }
+      cpos = (cpos+7) & ~size_t(7);
+      table_names += tname + " ";
+      if (tname == "frames") {
+        frame_rows = rows;
+      }
+    }
+    ASSERT("Columnar Output Has Game, Player, Frame, and Item Tables",cpos == cols.size() && table_names == "game players frames items ",
+      "Columnar output has tables " << table_names << "and ends at " << cpos << " of " << cols.size() << " bytes");
+    ASSERT("Columnar Frames Table Has a Row per Player Frame",frame_rows == expected_rows,
+      "Columnar frames table has " << frame_rows << " rows instead of " << expected_rows);
+
+    //Appending to a corpus picks up after the last complete game and its game_id,
+    //  whether an interrupted run stopped partway through a table or between tables
+    p = new slip::Parser(_debug);
+    p->load(known1.c_str());
+    std::string corpus = cols;
+    std::string partial;
+    {
+      OutputSink           corpus_sink([&corpus](const char* data, size_t len) { corpus.append(data,len); });
+      slip::ColumnarWriter w(corpus_sink);
+      slip::writeReplayColumns(*p->replay(),w,7);
+      OutputSink           partial_sink([&partial](const char* data, size_t len) { partial.append(data,len); });
+      slip::ColumnarWriter pw(partial_sink);
+      slip::writeReplayColumns(*p->replay(),pw,9);
+    }
+    delete p;
+    uint64_t complete = corpus.size();
+    size_t   partial_frames = partial.find(std::string("TABL\x06\x00" "frames",12));
+    const std::string cut_tails[] = { partial.substr(0,100), partial.substr(0,partial_frames) };
+    for (const std::string& cut : cut_tails) {
+      {
+        OutputSink corpus_file(tmpslpc.c_str());
+        corpus_file << corpus << cut;
+      }
+      uint64_t valid_end = 0;
+      int64_t  max_game_id = -1;
+      bool     scanned = slip::scanColumnarFile(tmpslpc.c_str(),valid_end,max_game_id);
+      remove(tmpslpc.c_str());
+      ASSERT("Corpus Scan Finds the Last Complete Game",scanned && valid_end == complete && max_game_id == 7,
+        "Corpus scan ended at " << valid_end << " of " << complete << " bytes with highest game_id " << max_game_id);
+    }
+
+    //Field selections limit JSON and columnar output to the requested fields
+    slip::FieldSelection sel;
+    std::string          bad_field;
+    ASSERT("Unknown Fields Are Rejected",!slip::parseFieldSelection("action_post,not_a_field",sel,bad_field) && bad_field == "not_a_field",
+      "Field selection accepted an unknown field (or blamed '" << bad_field << "')");
+    slip::parseFieldSelection("action_post,pos_x_post",sel,bad_field);
+    p = new slip::Parser(_debug);
+    p->setFields(&sel);
+    p->load(known2.c_str());
+    std::string sel_json = p->asJson(false);
+    std::string sel_cols;
+    {
+      OutputSink sel_sink([&sel_cols](const char* data, size_t len) { sel_cols.append(data,len); });
+      p->writeColumns(sel_sink);
+    }
+    delete p;
+    ASSERT("Selected JSON Only Has Selected Frame Fields",sel_json.find("\"pos_x_post\"") != std::string::npos
+      && sel_json.find("\"pos_y_post\"") == std::string::npos && sel_json.find("\"action_pre\"") == std::string::npos,
+      "JSON output with a field selection has the wrong frame fields");
+    ASSERT("Selected JSON is Smaller Than Full JSON",sel_json.size() < streamed_json.size() / 4,
+      "JSON output with a field selection is " << sel_json.size() << " bytes instead of " << streamed_json.size());
+    size_t sel_frames = sel_cols.find(std::string("TABL\x06\x00" "frames",12));
+    uint16_t sel_ncols = 0;
+    if (sel_frames != std::string::npos) {
+      memcpy(&sel_ncols,&sel_cols[sel_frames+20],2);
+    }
+    ASSERT("Selected Columnar Frames Table Only Has Selected Columns",sel_ncols == 6,
+      "Columnar frames table with a field selection has " << sel_ncols << " columns instead of 6");
+
+    //A dictionary trained on encoded replays round-trips them through the DICT codec
+    std::vector<std::pair<char*,unsigned>> dict_enc(2);
+    c = new slip::Compressor(_debug);
+    c->loadFromFile(known1.c_str());
+    dict_enc[0].second = c->saveToBuff(&dict_enc[0].first);
+    c->reset();
+    c->loadFromFile(known2.c_str());
+    dict_enc[1].second = c->saveToBuff(&dict_enc[1].first);
+    delete c;
+    std::string dict_data = trainDictionary({{dict_enc[0].first,dict_enc[0].second},{dict_enc[1].first,dict_enc[1].second}});
+    ASSERT("Dictionary Trains on Encoded Replays",dict_data.size() > 0 && dict_data.size() <= DICT_DEFAULT_SIZE,
+      "Trained dictionary is " << dict_data.size() << " bytes");
+    std::shared_ptr<const LzmaDictionary> dict = registerDictionary(dict_data.c_str(),dict_data.size());
+    ASSERT("Dictionary is Registered by ID",findDictionary(dict->id) == dict,
+      "Dictionary " << dictionaryIdString(dict->id) << " was not found after registering it");
+    std::string dict_comp = compressWithCodec(Codec::DICT,dict_enc[1].first,dict_enc[1].second,6,1,dict.get());
+    ASSERT("Dictionary Compressed Buffer is Tagged as DICT",detectCodec(dict_comp.c_str(),dict_comp.size()) == Codec::DICT,
+      "Dictionary compressed buffer is missing its codec tag");
+    uint32_t dict_dec_size = 0;
+    char*    dict_dec      = decompressWithCodec(dict_comp.c_str(),dict_comp.size(),dict_dec_size);
+    ASSERT("Dictionary Compressed Buffer Round-Trips",dict_dec != nullptr && dict_dec_size == dict_enc[1].second
+      && memcmp(dict_dec,dict_enc[1].first,dict_dec_size) == 0,
+      "Dictionary compressed buffer did not decompress to the original encoding");
+    delete[] dict_dec;
+    //Stored sizes past what the input could plausibly expand to aren't allocated up front,
+    //  but data that really does compress that well still decodes
+    std::string dict_bad = dict_comp;
+    writeBE4U(0xFFFFFFF0,&dict_bad[12]);
+    dict_dec = decompressWithCodec(dict_bad.c_str(),dict_bad.size(),dict_dec_size);
+    ASSERT("Dictionary Compressed Buffer with an Inflated Size is Rejected",dict_dec_size == 0,
+      "Dictionary compressed buffer claiming " << 0xFFFFFFF0 << " bytes decompressed to " << dict_dec_size);
+    delete[] dict_dec;
+    std::string zeros(1 << 22,'\0');
+    for (int codec : {Codec::LZMA, Codec::DICT}) {
+      std::string zcomp = compressWithCodec(codec,zeros.c_str(),zeros.size(),6,1,dict.get());
+      uint32_t    zsize = 0;
+      char*       zdec  = decompressWithCodec(zcomp.c_str(),zcomp.size(),zsize);
+      ASSERT("Highly Compressible Buffer Round-Trips with Codec "+std::to_string(codec),
+        zcomp.size()*MAX_TRUSTED_RATIO < zeros.size() && zsize == zeros.size() && memcmp(zdec,zeros.c_str(),zsize) == 0,
+        "Buffer compressed to " << zcomp.size() << " bytes decompressed to " << zsize << " bytes");
+      delete[] zdec;
+    }
+    delete[] dict_enc[0].first;
+    delete[] dict_enc[1].first;
+
+    //Blocked files decode whole, and decode frame ranges without the rest of the file
+    remove(tmpzlp.c_str());
+    remove(tmpunzlp.c_str());
+    c = new slip::Compressor(_debug);
+    c->setOutputFilename(tmpzlp.c_str());
+    c->setBlockFrames(600);
+    c->setStatsDetail(true);
+    ASSERT("Compressor Loads File for Blocking",c->loadFromFile(known2.c_str()),
+      "Compressor failed to load known file for blocking");
+    BAILONFAIL(1);
+    //Blocks are encoded and validated by validate(), even if the file is never saved
+    ASSERT("Compressor Validates Blocks Before Saving",c->validate(Validate::FULL) && c->stats().blocks > 1,
+      "Compressor validated " << c->stats().blocks << " blocks before saving");
+    c->saveToFile(false);
+    {
+      //Stats describe the blocks written, not a single stream of the whole replay
+      const slip::CompressorStats &st = c->stats();
+      std::string st_json = st.asJson();
+      ASSERT("Blocked Stats Count Blocks and the Blocked File Size",st.blocks > 1 && st.out_size == std::filesystem::file_size(tmpzlp),
+        "Blocked stats count " << st.blocks << " blocks and " << st.out_size << " output bytes");
+      ASSERT("Blocked Stats Count Predictions from the Blocks",st.preds[Predictor::VELOCITY] > st.fails[Predictor::VELOCITY],
+        "Blocked stats count " << st.preds[Predictor::VELOCITY] << " hits and " << st.fails[Predictor::VELOCITY] << " misses");
+      ASSERT("Blocked Stats Leave Out Per-event Byte Counts",st_json.find("\"events\" : {\n") != std::string::npos
+        && st_json.find("pre_frame") == std::string::npos,
+        "Blocked stats are " << st_json);
+    }
+    delete c;
+    uint32_t blk_size = 0;
+    bool     blk_mapped;
+    char*    blk_buf = mapFile(tmpzlp.c_str(),blk_size,blk_mapped);
+    ASSERT("Blocked File is Tagged as Blocked",blk_buf != nullptr && slip::Compressor::isBlocked(blk_buf,blk_size),
+      "Blocked file is missing its header or footer");
+    //A block count that only matches the index size after 32-bit wraparound is rejected
+    std::string blk_bad(blk_buf,blk_size);
+    unmapFile(blk_buf,blk_size,blk_mapped);
+    uint32_t blk_index = blk_size-8-readBE4U(&blk_bad[blk_size-8]);
+    writeBE4U(readBE4U(&blk_bad[blk_index+32])+(1u << 30),&blk_bad[blk_index+32]);
+    uint32_t blk_bad_size = 0;
+    char*    blk_bad_dec  = slip::Compressor::decodeBlocked(blk_bad.c_str(),blk_size,blk_bad_size);
+    ASSERT("Blocked File With Wrapped Block Count is Rejected",blk_bad_dec == nullptr,
+      "Blocked file with " << readBE4U(&blk_bad[blk_index+32]) << " blocks was decoded");
+    if (blk_bad_dec != nullptr) { delete[] blk_bad_dec; }
+    c = new slip::Compressor(_debug);
+    ASSERT("Compressor Loads Blocked File",c->loadFromFile(tmpzlp.c_str()),
+      "Compressor failed to load blocked known file");
+    BAILONFAIL(1);
+    c->saveToFile(false);
+    delete c;
+    std::string test_md5_5 = md5file(tmpunzlp.c_str());
+    ASSERT("MD5 of file restored from blocks is 7ea1aa5b49f87ab77a66bd8541810d50",test_md5_5.compare("7ea1aa5b49f87ab77a66bd8541810d50") == 0,
+      "MD5 of file restored from blocks is " << test_md5_5);
+
+    uint32_t clip_size;
+    char*    clip = slip::Compressor::loadFrameRange(tmpzlp.c_str(),1000,1999,clip_size);
+    ASSERT("Frame Range Decodes From Blocked File",clip != nullptr,
+      "Failed to decode frames 1000-1999 from blocked file");
+    BAILONFAIL(1);
+    ASSERT("Frame Range is Smaller than the Replay",clip_size < std::filesystem::file_size(tmpunzlp),
+      "Frame range is " << clip_size << " bytes");
+    // Walk the clip's events, checking every frame in the range (and no
+    //   other frame) is there, and that each player's last pre-frame event
+    //   for a frame (after rollbacks) matches the full replay
+    slip::Parser *full = new slip::Parser(_debug);
+    full->load(known2.c_str());
+    const SlippiReplay* full_r = full->replay();
+    uint16_t clip_sizes[256] = {0};
+    unsigned ev_bytes  = uint8_t(clip[N_HEADER_BYTES+1])-1;
+    for (unsigned i = 0; i < ev_bytes; i += 3) {
+      clip_sizes[uint8_t(clip[N_HEADER_BYTES+2+i])] = readBE2U(&clip[N_HEADER_BYTES+3+i])+1;
+    }
+    uint32_t clip_end  = N_HEADER_BYTES+readBE4U(&clip[11]);
+    bool     in_range  = true, same_frames = true;
+    std::map<int32_t,bool> seen;
+    std::map<std::pair<int32_t,unsigned>,std::pair<uint16_t,float>> last_pre;
+    for (uint32_t b = N_HEADER_BYTES+2+ev_bytes; b < clip_end && clip_sizes[uint8_t(clip[b])] > 0; b += clip_sizes[uint8_t(clip[b])]) {
+      unsigned ev_code = uint8_t(clip[b]);
+      if (ev_code != Event::PRE_FRAME && ev_code != Event::POST_FRAME && ev_code != Event::ITEM_UPDATE) {
+        continue;
+      }
+      int32_t fnum = readBE4S(&clip[b+O_FRAME]);
+      in_range     = in_range && fnum >= 1000 && fnum <= 1999;
+      seen[fnum]   = true;
+      if (ev_code == Event::PRE_FRAME) {
+        unsigned pid = uint8_t(clip[b+O_PLAYER])+4*uint8_t(clip[b+O_FOLLOWER]);
+        last_pre[{fnum,pid}] = {readBE2U(&clip[b+O_ACTION_PRE]),readBE4F(&clip[b+O_XPOS_PRE])};
+      }
+    }
+    for (const auto& kv : last_pre) {
+      if (!in_range) {
+        break;
+      }
+      const SlippiFrame &ff = full_r->player[kv.first.second].frame[kv.first.first-LOAD_FRAME];
+      same_frames = same_frames && ff.action_pre == kv.second.first && ff.pos_x_pre == kv.second.second;
+    }
+    ASSERT("Frame Range Holds Exactly Frames 1000-1999",in_range && seen.size() == 1000,
+      "Frame range holds " << seen.size() << " frames");
+    ASSERT("Frame Range Matches the Full Replay",same_frames,
+      "Frames decoded from the range differ from the full replay");
+    delete full;
+    delete[] clip;
+
   return 0;
 }
 
@@ -404,6 +821,120 @@ int testCompressionBackcompat() {
     return 0;
 }
 
+int testRNGRolls() {
+  TSUITE("RNG Roll Distance");
+    slip::Compressor *c = new slip::Compressor(_debug);
+    const uint32_t seeds[] = { 0x00000000, 0x00000001, 0x12345678, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF };
+    for (uint32_t seed : seeds) {
+      //Walk forward one roll at a time and check the jump-ahead / distance helpers agree
+      uint32_t cur = seed;
+      bool ok = true;
+      for (uint32_t n = 0; n < 1000; ++n) {
+        ok = ok && (c->jumpRNGLegacy(seed,n) == cur) && (c->distanceRNGLegacy(seed,cur) == n);
+        cur = c->rollRNGLegacy(cur);
+      }
+      ASSERT("Legacy jump / distance agree for seed "+std::to_string(seed),ok,
+        "Legacy jump / distance mismatch for seed " << seed);
+      uint32_t far = c->jumpRNGLegacy(seed,0xDEADBEEF);
+      ASSERT("Legacy distance inverts a far jump for seed "+std::to_string(seed),
+        c->distanceRNGLegacy(seed,far) == 0xDEADBEEF,
+        "Legacy distance for seed " << seed << " is " << c->distanceRNGLegacy(seed,far));
+    }
+    delete c;
+    return 0;
+}
+
+int testIncremental() {
+  TSUITE("Incremental Manifests");
+    const std::string dir     = (PATH(TESTDIR) / PATH(TMANIFESTDIR)).string();
+    const std::string rel     = "input.slp.xz";
+    const std::string infile  = (PATH(dir) / PATH(rel)).string();
+    const std::string outfile = (PATH(dir) / PATH("input-analysis.json")).string();
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::filesystem::copy_file(PATH(TESTDIR) / PATH(STANDARDDIR) / PATH(TSLPFILE), infile);
+    std::ofstream(outfile) << "{}";
+
+    // inputs are hashed as stored, not as decompressed for processing
+    uint32_t    size;
+    bool        mapped;
+    std::string md5;
+    char*       buf = loadReplayFile(infile.c_str(),size,mapped,&md5);
+    ASSERT("Loading a Replay Hashes the File as Stored",buf != nullptr && md5 == md5file(infile),
+      "Replay loaded with MD5 " << md5 << " instead of " << md5file(infile));
+    unmapFile(buf,size,mapped);
+
+    manifestentry e = statManifestInput(infile);
+    e.md5     = md5;
+    e.output  = true;
+    e.version = "v1";
+    manifest m;
+    m[rel]         = e;
+    m["other.slp"] = e;
+    ASSERT("Manifest is Saved",saveManifest(dir.c_str(),m),
+      "Could not save manifest in " << dir);
+    manifest loaded = loadManifest(dir.c_str());
+    ASSERT("Saved Manifest Loads Back",loaded.size() == 2 && loaded[rel].md5 == e.md5
+      && loaded[rel].size == e.size && loaded[rel].mtime == e.mtime
+      && loaded[rel].output == e.output && loaded[rel].version == e.version,
+      "Manifest loaded back with " << loaded.size() << " entries");
+
+    // entries appended as files are reported override earlier ones for the same input
+    std::ofstream journal;
+    ASSERT("Manifest Opens for Appending",openManifestJournal(dir.c_str(),journal),
+      "Could not open manifest in " << dir << " for appending");
+    manifestentry e2 = e;
+    e2.version = "v2";
+    appendManifestEntry(journal,"other.slp",e2);
+    loaded = loadManifest(dir.c_str());
+    ASSERT("Appended Manifest Entries are Flushed and Take Precedence",loaded.size() == 2
+      && loaded["other.slp"].version == "v2" && loaded[rel].version == "v1",
+      "Manifest has " << loaded.size() << " entries, with versions " << loaded[rel].version
+      << " and " << loaded["other.slp"].version);
+    journal.close();
+
+    manifestentry cur = statManifestInput(infile);
+    ASSERT("Unchanged Input is Skipped Without Hashing",manifestEntryCurrent(e,cur,"v1",infile,outfile) && cur.md5.empty(),
+      "Unchanged input was not skipped, or was hashed");
+    cur = statManifestInput(infile);
+    ASSERT("Input is Regenerated for a New Version",!manifestEntryCurrent(e,cur,"v2",infile,outfile),
+      "Input processed by an older version was skipped");
+
+    std::filesystem::last_write_time(infile,std::filesystem::last_write_time(infile) + std::chrono::hours(1));
+    cur = statManifestInput(infile);
+    ASSERT("Touched but Identical Input is Skipped",cur.mtime != e.mtime
+      && manifestEntryCurrent(e,cur,"v1",infile,outfile) && cur.md5 == e.md5,
+      "Touched input with MD5 " << cur.md5 << " was not skipped");
+
+    {
+      std::fstream f(infile,std::ios::in | std::ios::out | std::ios::binary);
+      f.seekg(e.size/2);
+      char b = f.get();
+      f.seekp(e.size/2);
+      f.put(~b);
+    }
+    cur = statManifestInput(infile);
+    ASSERT("Modified Input of the Same Size is Regenerated",cur.size == e.size
+      && !manifestEntryCurrent(e,cur,"v1",infile,outfile),
+      "Modified input was skipped");
+
+    e = statManifestInput(infile);
+    e.md5     = md5file(infile);
+    e.output  = true;
+    e.version = "v1";
+    std::filesystem::remove(outfile);
+    cur = statManifestInput(infile);
+    ASSERT("Input is Regenerated when its Output is Missing",!manifestEntryCurrent(e,cur,"v1",infile,outfile),
+      "Input whose output was deleted was skipped");
+    e.output = false;
+    cur = statManifestInput(infile);
+    ASSERT("Input that Wrote No Output is Skipped",manifestEntryCurrent(e,cur,"v1",infile,outfile),
+      "Input that legitimately wrote no output was not skipped");
+
+    std::filesystem::remove_all(dir);
+  return 0;
+}
+
 int testCompressionVersions() {
   slip::Compressor *c;
   TSUITE("All Version Compression");
@@ -428,6 +959,9 @@ int testCompressionVersions() {
       ASSERTNOERR("Compressor Loads "+name,loaded,
         "Compressor failed to load " << name);
       NEXTONFAIL();
+      ASSERT("Compressor Validates "+name+" In Place",c->validate(Validate::FAST),
+        "Compressor failed to validate " << name << " in place");
+      NEXTONFAIL();
       ASSERT("Compressor Validates "+name,c->validate(),
         "Compressor failed to validate " << name);
       NEXTONFAIL();
@@ -485,6 +1019,8 @@ int runtests(int argc, char** argv) {
   testKnownFiles();
   testCorruptFiles();
   testCompressionBackcompat();
+  testRNGRolls();
+  testIncremental();
   testConsistencySanity();
   if(testlevel >= 1) {
     testCompressionVersions();
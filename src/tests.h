@@ -8,6 +8,7 @@
 #include "parser.h"
 #include "analyzer.h"
 #include "compressor.h"
+#include "manifest.h"
 
 #ifdef _WIN32
 #include <Windows.h> //sleep()
@@ -19,8 +19,21 @@
 #include <algorithm> //std::find
 #include <sys/stat.h> //std::find
 #include <filesystem>
+#include <chrono>
+#include <time.h>     //clock_gettime
+#include <map>
+#include <memory>
+#include <mutex>
+
+#ifndef _WIN32
+#include <fcntl.h>    //open
+#include <unistd.h>   //close
+#include <sys/mman.h> //mmap
+#endif
 
 #include "lzma.h"
+#include "lz.h"
+#include "dict.h"
 #include "picohash.h"
 #include "shiftjis.h"
 
@@ -30,6 +43,8 @@
 
 const uint64_t SLP_HEADER  = BYTE8(0x7b,0x55,0x03,0x72,0x61,0x77,0x5b,0x24); // {U.raw[$
 const uint32_t LZMA_HEADER = BYTE4(0xfd,0x37,0x7a,0x58);
+const uint32_t LZ_HEADER   = BYTE4(0x5a,0x4c,0x5a,0x01); // ZLZ.
+const uint32_t DICT_HEADER = BYTE4(0x5a,0x4c,0x44,0x01); // ZLD.
 
 const unsigned N_HEADER_BYTES      =  15; //Header is always 15 bytes
 const unsigned MIN_EV_PAYLOAD_SIZE =  14; //Payloads, game start, pre frame, post frame, game end always defined
@@ -48,20 +63,28 @@ const unsigned MIN_REPLAY_LENGTH   = N_HEADER_BYTES + MIN_EV_PAYLOAD_SIZE + MIN_
 // Variable checking whether error log has been initialized
 static bool errlog_init = false;
 
+//Stream that all output from the macros below is written to; threads may point
+//  their own copy at a private buffer to keep their output from interleaving
+inline std::ostream*& logStream() {
+  thread_local std::ostream* stream = &std::cerr;
+  return stream;
+}
+#define LOGOUT (*logStream())
+
 //Debug output convenience macros
-#define DOUT1(s) if (_debug >= 1) { std::cerr << "  " << BLU << "DEBUG 1: " << BLN << s << std::endl; }
-#define DOUT2(s) if (_debug >= 2) { std::cerr << "  " << BLU << "DEBUG 2: " << BLN << s << std::endl; }
-#define DOUT3(s) if (_debug >= 3) { std::cerr << "  " << BLU << "DEBUG 3: " << BLN << s << std::endl; }
-#define INFO(e)                     std::cerr << "  " << GRN << "   INFO: " << BLN << e << std::endl;
-#define WARN(e)                     std::cerr << "  " << YLW << "WARNING: " << BLN << e << std::endl;
-#define FAIL(e)                     std::cerr << "  " << RED << "  ERROR: " << BLN << e << std::endl;
-#define YIKES(e)                    std::cerr << "  " << CRT << "  YIKES: " << BLN << e << std::endl;
-#define WARN_CORRUPT(e)             std::cerr << "  " << YLW << "WARNING: " << BLN << e << "; replay may be corrupt"   << std::endl;
-#define FAIL_CORRUPT(e)             std::cerr << "  " << RED << "  ERROR: " << BLN << e << "; cannot continue parsing" << std::endl;
+#define DOUT1(s) if (_debug >= 1) { LOGOUT << "  " << BLU << "DEBUG 1: " << BLN << s << std::endl; }
+#define DOUT2(s) if (_debug >= 2) { LOGOUT << "  " << BLU << "DEBUG 2: " << BLN << s << std::endl; }
+#define DOUT3(s) if (_debug >= 3) { LOGOUT << "  " << BLU << "DEBUG 3: " << BLN << s << std::endl; }
+#define INFO(e)                     LOGOUT << "  " << GRN << "   INFO: " << BLN << e << std::endl;
+#define WARN(e)                     LOGOUT << "  " << YLW << "WARNING: " << BLN << e << std::endl;
+#define FAIL(e)                     LOGOUT << "  " << RED << "  ERROR: " << BLN << e << std::endl;
+#define YIKES(e)                    LOGOUT << "  " << CRT << "  YIKES: " << BLN << e << std::endl;
+#define WARN_CORRUPT(e)             LOGOUT << "  " << YLW << "WARNING: " << BLN << e << "; replay may be corrupt"   << std::endl;
+#define FAIL_CORRUPT(e)             LOGOUT << "  " << RED << "  ERROR: " << BLN << e << "; cannot continue parsing" << std::endl;
 #define _LOG(e) \
-  std::cerr << "  " << MGN << "    LOG: " << BLN << e << std::endl;
+  LOGOUT << "  " << MGN << "    LOG: " << BLN << e << std::endl;
 #define LOG(e,f) {\
-  std::cerr << "  " << MGN << "    LOG: " << BLN << e << std::endl; \
+  LOGOUT << "  " << MGN << "    LOG: " << BLN << e << std::endl; \
   std::ofstream log(f, std::ios_base::app | std::ios_base::out); \
   log << "  [" << timestamp() << "] " << e << std::endl; \
   log.close(); };
@@ -164,6 +187,8 @@ inline uint32_t readBE4U(char* array) { return swap32(*((uint32_t*)array)); }
 inline uint16_t readBE2U(char* array) { return swap16(*((uint16_t*)array)); }
 //Load a big-endian 32-bit int from an array
 inline int32_t  readBE4S(char* array) { return swap32(*((int32_t*)array)); }
+//Load a big-endian 64-bit unsigned int from an array
+inline uint64_t readBE8U(char* array) { return (uint64_t(readBE4U(array)) << 32) | readBE4U(array+4); }
 //Load a big-endian 16-bit int from an array
 inline int16_t  readBE2S(char* array) { return swap16(*((int16_t*)array)); }
 //Load a big-endian float from an array
@@ -200,6 +225,12 @@ inline void  writeBE4U(uint32_t i, char* a) {
   a[0] = (i>>24) & 0xff;
 }
 
+//Write a big-endian 64-bit unsigned int to an array
+inline void  writeBE8U(uint64_t i, char* a) {
+  writeBE4U(uint32_t(i >> 32), a);
+  writeBE4U(uint32_t(i), a+4);
+}
+
 //Write a big-endian 32-bit signed int to an array
 inline void  writeBE4S(int32_t i, char* a) {
   a[3] =  i      & 0xff;
@@ -447,9 +478,46 @@ inline std::string floatToBinary(float f) {
   return temp;
 }
 
+// Smallest block handed to each thread by multithreaded LZMA compression;
+//   smaller blocks parallelize better but lose more ratio at block boundaries
+const size_t LZMA_MIN_BLOCK_SIZE = 1 << 18;
+
+// Largest expansion we trust an uncompressed size stored with compressed data
+//   to describe before allocating it up front (real replays expand about 10x
+//   from .slp.xz and 25x from .zlp); larger claims are decoded into a growing
+//   buffer instead, so a corrupt size can't allocate more than the data holds
+const uint64_t MAX_TRUSTED_RATIO = 64;
+
+// Compress with a multithreaded .xz encoder, splitting the input into one
+//   block per thread (decodes with the same single-stream decoder as below)
+inline bool compressWithLzmaMt(const char* in, const size_t inlen, uint32_t preset, unsigned threads, std::string &result) {
+  lzma_mt mt      = {};
+  mt.threads      = threads;
+  mt.preset       = preset;
+  mt.check        = LZMA_CHECK_CRC32;
+  mt.block_size   = std::max(LZMA_MIN_BLOCK_SIZE, (inlen + threads - 1) / threads);
+  lzma_stream strm = LZMA_STREAM_INIT;
+  if (lzma_stream_encoder_mt(&strm, &mt) != LZMA_OK) {
+    return false;
+  }
+  result.resize(lzma_stream_buffer_bound(inlen));
+  strm.next_in   = reinterpret_cast<const uint8_t*>(in);
+  strm.avail_in  = inlen;
+  strm.next_out  = reinterpret_cast<uint8_t*>(&result[0]);
+  strm.avail_out = result.size();
+  lzma_ret ret   = lzma_code(&strm, LZMA_FINISH);
+  result.resize(result.size() - strm.avail_out);
+  lzma_end(&strm);
+  return ret == LZMA_STREAM_END;
+}
+
 // http://ptspts.blogspot.com/2011/11/how-to-simply-compress-c-string-with.html
-inline std::string compressWithLzma(const char* in, const size_t inlen, int level = 6) {
+//   level may include LZMA_PRESET_EXTREME; threads > 1 uses the multithreaded encoder
+inline std::string compressWithLzma(const char* in, const size_t inlen, uint32_t level = 6, unsigned threads = 1) {
   std::string result;
+  if (threads > 1 && compressWithLzmaMt(in, inlen, level, threads, result)) {
+    return result;
+  }
   result.resize(inlen + (inlen >> 2) + 128);
   size_t out_pos = 0;
   if (LZMA_OK != lzma_easy_buffer_encode(
@@ -501,6 +569,445 @@ inline std::string decompressWithLzma(const char* in, const size_t inlen) {
   return decompressWithLzma(reinterpret_cast<const uint8_t*>(&in[0]),inlen);
 }
 
+//Read the total uncompressed size of a (possibly concatenated) .xz stream from
+//  the index at the end of each stream, without decoding anything
+//  -> Returns 0 if the size can't be determined
+inline uint64_t lzmaUncompressedSize(const uint8_t* in, const size_t inlen) {
+  uint64_t total = 0;
+  size_t   end   = inlen;
+  while (end > 0) {
+    // Skip stream padding (always a multiple of 4 null bytes)
+    while (end >= 4 && in[end-1] == 0 && in[end-2] == 0 && in[end-3] == 0 && in[end-4] == 0) {
+      end -= 4;
+    }
+    if (end < 2*LZMA_STREAM_HEADER_SIZE) {
+      return 0;
+    }
+    lzma_stream_flags footer;
+    if (lzma_stream_footer_decode(&footer, &in[end-LZMA_STREAM_HEADER_SIZE]) != LZMA_OK) {
+      return 0;
+    }
+    size_t index_end = end-LZMA_STREAM_HEADER_SIZE;
+    if (footer.backward_size > index_end) {
+      return 0;
+    }
+    lzma_index* index   = nullptr;
+    uint64_t    memlim  = UINT64_MAX;
+    size_t      in_pos  = index_end-footer.backward_size;
+    if (lzma_index_buffer_decode(&index, &memlim, NULL, in, &in_pos, index_end) != LZMA_OK) {
+      return 0;
+    }
+    uint64_t stream_size = lzma_index_stream_size(index);
+    total               += lzma_index_uncompressed_size(index);
+    lzma_index_end(index, NULL);
+    if (stream_size > end) {
+      return 0;
+    }
+    end -= stream_size;
+  }
+  return total;
+}
+
+//Decompress an .xz stream directly into a caller-provided buffer of exactly
+//  outlen bytes; returns false if the stream doesn't decode to exactly outlen
+inline bool decompressWithLzma(const uint8_t* in, const size_t inlen, uint8_t* out, const size_t outlen) {
+  static const size_t kMemLimit = 1 << 30;  // 1 GB.
+  lzma_stream strm = LZMA_STREAM_INIT;
+  if (lzma_stream_decoder(&strm, kMemLimit, LZMA_CONCATENATED) != LZMA_OK) {
+    return false;
+  }
+  strm.next_in   = in;
+  strm.avail_in  = inlen;
+  strm.next_out  = out;
+  strm.avail_out = outlen;
+  lzma_ret ret   = lzma_code(&strm, LZMA_FINISH);
+  bool success   = (ret == LZMA_STREAM_END) && (strm.avail_out == 0);
+  lzma_end(&strm);
+  return success;
+}
+
+//Decompress an .xz stream into a new buffer, sized exactly from the stream's
+//  index so the output is written once with no reallocation or extra copies
+//  -> Falls back to decompressing with a growing buffer if the index is
+//     unreadable or claims more than MAX_TRUSTED_RATIO times the input
+inline char* decompressWithLzma(const char* in, const size_t inlen, uint32_t &outlen) {
+  const uint8_t* uin = reinterpret_cast<const uint8_t*>(in);
+  uint64_t size      = lzmaUncompressedSize(uin, inlen);
+  if (size > 0 && size <= UINT32_MAX && size / MAX_TRUSTED_RATIO <= inlen) {
+    char* out = new char[size];
+    if (decompressWithLzma(uin, inlen, reinterpret_cast<uint8_t*>(out), size)) {
+      outlen = size;
+      return out;
+    }
+    delete[] out;
+  }
+  std::string decomp = decompressWithLzma(uin, inlen);
+  outlen             = decomp.size();
+  char* out          = new char[outlen];
+  memcpy(out,decomp.c_str(),outlen);
+  return out;
+}
+
+//Backends for compressing encoded replays, identified in .zlp files by their first 4 bytes
+namespace Codec {
+  enum {
+    LZMA = 0,  //.xz stream (LZMA_HEADER); best ratio
+    LZ   = 1,  //LZ_HEADER, big-endian uncompressed size, then an LZ block (lz.h); much faster to decode
+    NONE = 2,  //No header; the encoded replay as is
+    DICT = 3,  //DICT_HEADER, big-endian dictionary ID and uncompressed size, then a raw LZMA2 stream primed with that dictionary
+  };
+}
+
+//A preset dictionary for compressing many small replays with LZMA, trained
+//  with trainDictionary() and identified by the first 8 bytes of its MD5
+struct LzmaDictionary {
+  uint64_t    id = 0;
+  std::string data;
+};
+
+inline std::string dictionaryIdString(uint64_t id) {
+  std::stringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << id;
+  return ss.str();
+}
+
+//Dictionaries that compressed replays may refer to, keyed by ID
+inline std::map<uint64_t,std::shared_ptr<const LzmaDictionary>>& dictionaryRegistry(std::mutex*& lock) {
+  static std::mutex m;
+  static std::map<uint64_t,std::shared_ptr<const LzmaDictionary>> registry;
+  lock = &m;
+  return registry;
+}
+
+//Register a dictionary's contents so replays compressed with it can be decompressed
+inline std::shared_ptr<const LzmaDictionary> registerDictionary(const char* data, size_t size) {
+  picohash_ctx_t ctx;
+  unsigned char  digest[PICOHASH_MD5_DIGEST_LENGTH];
+  picohash_init_md5(&ctx);
+  picohash_update(&ctx, data, size);
+  picohash_final(&ctx, digest);
+  std::shared_ptr<LzmaDictionary> dict = std::make_shared<LzmaDictionary>();
+  for (unsigned i = 0; i < 8; ++i) {
+    dict->id = (dict->id << 8) | digest[i];
+  }
+  dict->data.assign(data, size);
+  std::mutex* lock;
+  auto& registry = dictionaryRegistry(lock);
+  std::lock_guard<std::mutex> guard(*lock);
+  registry[dict->id] = dict;
+  return dict;
+}
+
+//Find a registered dictionary by ID (nullptr if there's none)
+inline std::shared_ptr<const LzmaDictionary> findDictionary(uint64_t id) {
+  std::mutex* lock;
+  auto& registry = dictionaryRegistry(lock);
+  std::lock_guard<std::mutex> guard(*lock);
+  auto it = registry.find(id);
+  return (it == registry.end()) ? nullptr : it->second;
+}
+
+//LZMA2 options for a preset primed with a dictionary; the window only ever
+//  needs to cover the dictionary and the replay itself
+inline bool lzmaDictOptions(lzma_options_lzma &opts, uint32_t level, const LzmaDictionary &dict, size_t datalen) {
+  if (lzma_lzma_preset(&opts, level)) {
+    return false;
+  }
+  opts.preset_dict      = reinterpret_cast<const uint8_t*>(dict.data.data());
+  opts.preset_dict_size = dict.data.size();
+  opts.dict_size        = std::max<uint64_t>(LZMA_DICT_SIZE_MIN, std::min<uint64_t>(opts.dict_size, dict.data.size() + datalen));
+  return true;
+}
+
+//Compress with a raw LZMA2 stream primed with a dictionary (always single-threaded)
+inline std::string compressWithDictionary(const char* in, const size_t inlen, uint32_t level, const LzmaDictionary &dict) {
+  std::string result;
+  lzma_options_lzma opts;
+  if (!lzmaDictOptions(opts, level, dict, inlen)) {
+    return result;
+  }
+  lzma_filter filters[2] = {{LZMA_FILTER_LZMA2, &opts}, {LZMA_VLI_UNKNOWN, NULL}};
+  result.resize(16 + lzma_stream_buffer_bound(inlen));
+  memcpy(&result[0], &DICT_HEADER, 4);
+  writeBE8U(dict.id, &result[4]);
+  writeBE4U(uint32_t(inlen), &result[12]);
+  size_t out_pos = 16;
+  if (LZMA_OK != lzma_raw_buffer_encode(filters, NULL,
+      reinterpret_cast<const uint8_t*>(in), inlen,
+      reinterpret_cast<uint8_t*>(&result[0]), &out_pos, result.size()))
+    abort();
+  result.resize(out_pos);
+  return result;
+}
+
+//Decode a raw LZMA stream into a buffer that grows as output is produced, up
+//  to maxlen bytes; returns false if the stream is invalid or decodes to more
+inline bool decompressRawLzma(const lzma_filter* filters, const uint8_t* in, const size_t inlen,
+  const size_t maxlen, std::string &result) {
+  lzma_stream strm = LZMA_STREAM_INIT;
+  if (lzma_raw_decoder(&strm, filters) != LZMA_OK) {
+    return false;
+  }
+  // one byte of room past maxlen so the end of the stream can still be read
+  //   after exactly maxlen bytes, and so longer output is caught
+  const size_t cap = maxlen + 1;
+  size_t used      = 0;
+  lzma_ret ret     = LZMA_OK;
+  result.resize(std::min<size_t>(cap, std::max<size_t>(8192, inlen << 2)));
+  strm.next_in  = in;
+  strm.avail_in = inlen;
+  while (ret == LZMA_OK) {
+    strm.next_out  = reinterpret_cast<uint8_t*>(&result[used]);
+    strm.avail_out = result.size() - used;
+    ret            = lzma_code(&strm, LZMA_FINISH);
+    used           = result.size() - strm.avail_out;
+    if (ret == LZMA_OK && strm.avail_out == 0) {
+      if (result.size() == cap) {
+        break;
+      }
+      result.resize(std::min<size_t>(cap, result.size() << 1));
+    }
+  }
+  lzma_end(&strm);
+  result.resize(used);
+  return (ret == LZMA_STREAM_END) && (used <= maxlen);
+}
+
+//Decompress a DICT_HEADER buffer into a new buffer (outlen = 0 on failure,
+//  including when its dictionary hasn't been registered)
+inline char* decompressWithDictionary(const char* in, const size_t inlen, uint32_t &outlen) {
+  outlen = 0;
+  if (inlen < 16) {
+    return new char[0];
+  }
+  char*    buf  = const_cast<char*>(in);
+  uint64_t id   = readBE8U(&buf[4]);
+  uint32_t size = readBE4U(&buf[12]);
+  std::shared_ptr<const LzmaDictionary> dict = findDictionary(id);
+  if (dict == nullptr) {
+    FAIL("  Replay was compressed with dictionary " << dictionaryIdString(id) << ", which hasn't been loaded");
+    return new char[0];
+  }
+  // the window for the highest preset covers any window the replay could have
+  //   been compressed with, without trusting the stored size past that
+  lzma_options_lzma opts;
+  if (!lzmaDictOptions(opts, 9, *dict, size)) {
+    return new char[0];
+  }
+  lzma_filter filters[2] = {{LZMA_FILTER_LZMA2, &opts}, {LZMA_VLI_UNKNOWN, NULL}};
+  if (size / MAX_TRUSTED_RATIO > inlen) {
+    // too large to allocate on the header's word alone; see what actually decodes
+    std::string decomp;
+    if (!decompressRawLzma(filters, reinterpret_cast<const uint8_t*>(&in[16]), inlen - 16, size, decomp)
+      || decomp.size() != size) {
+      return new char[0];
+    }
+    char* out = new char[size];
+    memcpy(out, decomp.data(), size);
+    outlen    = size;
+    return out;
+  }
+  char*  out     = new char[size];
+  size_t in_pos  = 16, out_pos = 0;
+  if (LZMA_OK == lzma_raw_buffer_decode(filters, NULL,
+      reinterpret_cast<const uint8_t*>(in), &in_pos, inlen,
+      reinterpret_cast<uint8_t*>(out), &out_pos, size) && out_pos == size) {
+    outlen = size;
+  }
+  return out;
+}
+
+//Compress an encoded replay with the given codec; level and threads only apply
+//  to LZMA, and DICT falls back to LZMA without a dictionary
+inline std::string compressWithCodec(int codec, const char* in, const size_t inlen, uint32_t level = 6, unsigned threads = 1,
+  const LzmaDictionary* dict = nullptr) {
+  if (codec == Codec::DICT && dict != nullptr) {
+    return compressWithDictionary(in, inlen, level, *dict);
+  }
+  if (codec == Codec::LZMA || codec == Codec::DICT) {
+    return compressWithLzma(in, inlen, level, threads);
+  }
+  if (codec == Codec::NONE) {
+    return std::string(in, inlen);
+  }
+  std::string result;
+  result.resize(8 + lzCompressBound(inlen));
+  memcpy(&result[0], &LZ_HEADER, 4);
+  uint32_t size = swap32(uint32_t(inlen));
+  memcpy(&result[4], &size, 4);
+  size_t n = compressLzBlock(reinterpret_cast<const uint8_t*>(in), inlen, reinterpret_cast<uint8_t*>(&result[8]));
+  result.resize(8 + n);
+  return result;
+}
+
+//Which codec a buffer was compressed with, from its first 4 bytes
+inline int detectCodec(const char* buf, const size_t size) {
+  uint32_t magic = 0;
+  if (size >= 4) {
+    memcpy(&magic, buf, 4);
+  }
+  if (magic == LZMA_HEADER) {
+    return Codec::LZMA;
+  }
+  if (magic == LZ_HEADER && size >= 8) {
+    return Codec::LZ;
+  }
+  if (magic == DICT_HEADER && size >= 16) {
+    return Codec::DICT;
+  }
+  return Codec::NONE;
+}
+
+//Decompress a buffer compressed with any codec into a new buffer (outlen = 0 on failure)
+inline char* decompressWithCodec(const char* in, const size_t inlen, uint32_t &outlen) {
+  switch (detectCodec(in, inlen)) {
+    case Codec::LZMA:
+      return decompressWithLzma(in, inlen, outlen);
+    case Codec::DICT:
+      return decompressWithDictionary(in, inlen, outlen);
+    case Codec::LZ: {
+      memcpy(&outlen, &in[4], 4);
+      outlen    = swap32(outlen);
+      if (outlen / 256 > inlen) {  //More than any LZ block can expand to
+        outlen = 0;
+        return new char[0];
+      }
+      char* out = new char[outlen];
+      if (!decompressLzBlock(reinterpret_cast<const uint8_t*>(&in[8]), inlen - 8, reinterpret_cast<uint8_t*>(out), outlen)) {
+        outlen = 0;
+      }
+      return out;
+    }
+    default:
+      outlen    = inlen;
+      char* out = new char[outlen];
+      memcpy(out, in, outlen);
+      return out;
+  }
+}
+
+//Read an entire file into a new heap buffer; returns nullptr on failure
+//  (including files too large for a 32-bit size)
+inline char* readFile(const char* fname, uint32_t &size) {
+  std::ifstream f;
+  f.open(fname,std::ios::binary | std::ios::in);
+  if (f.fail()) {
+    return nullptr;
+  }
+  f.seekg(0, f.end);
+  std::streamoff len = f.tellg();
+  if (len < 0 || len >= std::streamoff(UINT32_MAX)) {  //+1 below must not wrap
+    return nullptr;
+  }
+  size = uint32_t(len);
+  f.seekg(0, f.beg);
+  char* buf = new char[size+1];  //+1 so empty files still get a valid buffer
+  f.read(buf,size);
+  f.close();
+  return buf;
+}
+
+//Map an entire file into memory; pages are mapped copy-on-write, so callers
+//  may modify the buffer without touching the file on disk. Falls back to
+//  readFile() where mapping isn't available. Returns nullptr on failure
+//  (including files too large for a 32-bit size, which would otherwise be
+//  only partly unmapped); mapped tells whether the buffer must be released
+//  with unmapFile()
+inline char* mapFile(const char* fname, uint32_t &size, bool &mapped) {
+  mapped = false;
+#ifndef _WIN32
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat s;
+  bool regular = fstat(fd,&s) == 0 && S_ISREG(s.st_mode);
+  if (regular && uint64_t(s.st_size) > UINT32_MAX) {
+    close(fd);
+    return nullptr;
+  }
+  if (regular && s.st_size > 0) {
+    void* m = mmap(nullptr, s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (m != MAP_FAILED) {
+      close(fd);
+      //We read every byte anyway, so ask for the whole file to be read ahead
+      //  (MAP_POPULATE would break copy-on-write and duplicate every page)
+      madvise(m, s.st_size, MADV_WILLNEED);
+      size   = s.st_size;
+      mapped = true;
+      return static_cast<char*>(m);
+    }
+  }
+  close(fd);
+#endif
+  return readFile(fname,size);
+}
+
+//Release a buffer returned by mapFile()
+inline void unmapFile(char* buf, uint32_t size, bool mapped) {
+  if (buf == nullptr) {
+    return;
+  }
+#ifndef _WIN32
+  if (mapped) {
+    munmap(buf,size);
+    return;
+  }
+#endif
+  delete[] buf;
+}
+
+//Ask the OS to start reading a file into the page cache in the background,
+//  so it's already in memory by the time we actually open it
+inline void prefetchFile(const char* fname) {
+#ifndef _WIN32
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  close(fd);
+#endif
+}
+
+inline std::string md5tostring(unsigned char* digest) {
+  std::stringstream ss;
+  ss << std::hex << std::setfill('0');
+  for (int i = 0; i < 16; ++i) {
+      ss << std::setw(2) << static_cast<unsigned>(digest[i]);
+  }
+  return ss.str();
+}
+
+inline std::string md5data(unsigned char* buffer, size_t length) {
+  picohash_ctx_t ctx;
+  unsigned char digest[PICOHASH_MD5_DIGEST_LENGTH];
+  picohash_init_md5(&ctx);
+  picohash_update(&ctx, buffer, length);
+  picohash_final(&ctx, digest);
+
+  return md5tostring(digest);
+}
+
+//Load a replay with mapFile(), replacing it with its decompressed contents if
+//  it's compressed with any codec; release the result with unmapFile() as with mapFile().
+//  If md5 is given, it's set to the MD5 of the file as stored (before decompression).
+inline char* loadReplayFile(const char* fname, uint32_t &size, bool &mapped, std::string* md5 = nullptr) {
+  char* buf = mapFile(fname,size,mapped);
+  if (buf != nullptr && md5 != nullptr) {
+    *md5 = md5data(reinterpret_cast<unsigned char*>(buf), size);
+  }
+  if (buf == nullptr || detectCodec(buf,size) == Codec::NONE) {
+    return buf;
+  }
+  uint32_t decomp_size;
+  char*    decomp = decompressWithCodec(buf, size, decomp_size);
+  unmapFile(buf,size,mapped);
+  mapped = false;
+  size   = decomp_size;
+  return decomp;
+}
+
 inline bool fileExists(std::string fname) {
    std::ifstream i(fname.c_str());
    return i.good();
@@ -562,54 +1069,56 @@ inline std::string getFileExt(std::string f) {
   return f.substr(extpos+1,f.size()-(extpos+1));
 }
 
-inline void stringtoChars(std::string s, char** c) {
-  *c = new char[s.size()+1];
-  strcpy(*c, s.c_str());
-}
-
-inline std::string md5tostring(unsigned char* digest) {
-  std::stringstream ss;
-  ss << std::hex << std::setfill('0');
-  for (int i = 0; i < 16; ++i) {
-      ss << std::setw(2) << static_cast<unsigned>(digest[i]);
+//Match a file name against a shell-style glob pattern ('*' matches any run
+//  of characters, '?' matches any single character)
+inline bool matchGlob(const char* pattern, const char* name) {
+  const char* star  = nullptr;  //position of the last '*' seen in the pattern
+  const char* retry = nullptr;  //position in name to resume from after a mismatch
+  while (*name) {
+    if (*pattern == '*') {
+      star  = pattern++;
+      retry = name;
+    } else if (*pattern == '?' || *pattern == *name) {
+      ++pattern;
+      ++name;
+    } else if (star) {
+      pattern = star+1;
+      name    = ++retry;
+    } else {
+      return false;
+    }
   }
-  return ss.str();
+  while (*pattern == '*') {
+    ++pattern;
+  }
+  return *pattern == '\0';
 }
 
-inline std::string md5data(unsigned char* buffer, size_t length) {
-  picohash_ctx_t ctx;
-  unsigned char digest[PICOHASH_MD5_DIGEST_LENGTH];
-  picohash_init_md5(&ctx);
-  picohash_update(&ctx, buffer, length);
-  picohash_final(&ctx, digest);
-
-  return md5tostring(digest);
+inline void stringtoChars(std::string s, char** c) {
+  *c = new char[s.size()+1];
+  strcpy(*c, s.c_str());
 }
 
 inline std::string md5file(std::string fname, bool compressed = false) {
-  FILE* f = fopen(fname.c_str(),"r");
-  fseek(f, 0, SEEK_END);
-  size_t length = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  unsigned char* b = (unsigned char*)malloc(length);
-  fread(b,1,length,f);
-  fclose(f);
+  uint32_t length;
+  bool     mapped;
+  char*    b = mapFile(fname.c_str(),length,mapped);
+  if (b == nullptr) {
+    return "";
+  }
 
   if (compressed) {
-    std::string decomp = decompressWithLzma(b, length);
-    // Get the new file size
-    length = decomp.size();
-    // Delete the old read buffer
-    free(b);
-    // Reallocate it with more spce
-    b = (unsigned char*)malloc(length);
-    // Copy buffer from the decompressed string
-    memcpy(b,decomp.c_str(),length);
+    uint32_t decomp_length;
+    char*    decomp = decompressWithLzma(b,length,decomp_length);
+    unmapFile(b,length,mapped);
+    b      = decomp;
+    length = decomp_length;
+    mapped = false;
   }
 
-  std::string m = md5data(b, length);
+  std::string m = md5data(reinterpret_cast<unsigned char*>(b), length);
 
-  free(b);
+  unmapFile(b,length,mapped);
 
   return m;
 }
@@ -644,6 +1153,18 @@ inline auto timestamp() {
   return std::put_time(std::localtime(&time_now), "%Y-%m-%d %OH:%OM:%OS");
 }
 
+//Milliseconds of wall time since an arbitrary fixed point
+inline double wallMs() {
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Milliseconds of CPU time used so far by the calling thread (not any threads it started)
+inline double threadCpuMs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts);
+  return 1000.0*ts.tv_sec + ts.tv_nsec/1e6;
+}
+
 inline bool ensureExt(const char* ext, const char* fname) {
   std::string fs(fname);
   return (fs.substr(fs.length()-4,4).compare(ext) == 0);